@@ -0,0 +1,5 @@
+#include <BenchMain.hpp>
+
+int main(int argc, const char* argv[]) {
+    return benchMain(argc, argv);
+}
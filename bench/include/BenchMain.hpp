@@ -0,0 +1,3 @@
+#pragma once
+
+int benchMain(int argc, const char* argv[]);
@@ -0,0 +1,38 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include <functional>
+#include <string>
+
+class Benchmark {
+    std::string m_name;
+    std::function<void(size_t)> m_benchmark;
+    size_t m_iterations;
+
+public:
+    Benchmark() = delete;
+    Benchmark(const std::string& name, const std::function<void(size_t)> benchmark, size_t iterations);
+
+    const std::string& name() const;
+    size_t iterations() const;
+    void run() const;
+};
+
+#define BENCHMARK(suite, fn, iterations)\
+    suite.add(Benchmark(#fn, fn, iterations));
+
+class BenchmarkSuite {
+private:
+    std::vector<Benchmark> m_benchmarks;
+
+public:
+    void run();
+    void add(const Benchmark& benchmark);
+};
+
+/**
+ * Keeps the compiler from optimizing away a value computed by a benchmark.
+ */
+template <typename T> void doNotOptimize(const T& value) {
+    asm volatile("" : : "r,m"(value) : "memory");
+}
@@ -0,0 +1,294 @@
+#include <Malloc.hpp>
+#include <Benchmark.hpp>
+#include <ArenaBench.hpp>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <vector>
+
+/**
+ * The number of 8-byte items each churn round allocates before freeing them all.
+ */
+constexpr size_t churnBatch = 64;
+
+/**
+ * The number of 8-byte items kept live by the random replacement benchmarks.
+ */
+constexpr size_t liveSetSize = 16 * 1024;
+
+/**
+ * Allocates a batch of 8-byte items and frees them in reverse, over and over.
+ */
+void churn8(SlotMode mode, size_t iterations) {
+    ArenaStore store;
+    store.setSlotMode(mode);
+
+    void* ptrs[churnBatch];
+
+    for (size_t i = 0; i < iterations; i += churnBatch) {
+        for (auto& ptr : ptrs) {
+            ptr = store.alloc(8);
+        }
+
+        doNotOptimize(ptrs);
+
+        for (size_t j = churnBatch; j > 0; j--) {
+            store.free(ptrs[j - 1]);
+        }
+    }
+}
+
+/**
+ * Keeps a large set of 8-byte items live and repeatedly replaces a random one,
+ * so arenas are freed into in a scattered order.
+ */
+void randomReplace8(SlotMode mode, size_t iterations, ArenaLayout layout = ArenaLayout::Heap) {
+    ArenaStore store;
+    store.setSlotMode(mode);
+    store.setArenaLayout(layout);
+
+    std::vector<void*> live(liveSetSize);
+    srand(42);
+
+    for (auto& ptr : live) {
+        ptr = store.alloc(8);
+    }
+
+    for (size_t i = 0; i < iterations; i++) {
+        size_t victim = rand() % liveSetSize;
+
+        store.free(live[victim]);
+        live[victim] = store.alloc(8);
+    }
+
+    doNotOptimize(live.data());
+
+    for (auto ptr : live) {
+        store.free(ptr);
+    }
+}
+
+void freeListChurn8(size_t iterations) {
+    churn8(SlotMode::FreeList, iterations);
+}
+
+void bitmapChurn8(size_t iterations) {
+    churn8(SlotMode::Bitmap, iterations);
+}
+
+void freeListRandomReplace8(size_t iterations) {
+    randomReplace8(SlotMode::FreeList, iterations);
+}
+
+void bitmapRandomReplace8(size_t iterations) {
+    randomReplace8(SlotMode::Bitmap, iterations);
+}
+
+void classRegionRandomReplace8(size_t iterations) {
+    randomReplace8(SlotMode::FreeList, iterations, ArenaLayout::ClassRegions);
+}
+
+/**
+ * Allocates, touches and frees request buffers of a few sizes between 8 KiB and
+ * 256 KiB, as a server handling requests back to back would.
+ */
+void bigAllocReuse(size_t iterations) {
+    constexpr size_t sizes[] = {8 << 10, 64 << 10, 100 << 10, 256 << 10};
+
+    ArenaStore store;
+
+    for (size_t i = 0; i < iterations; i++) {
+        size_t size = sizes[i % 4];
+        char* buffer = static_cast<char*>(store.alloc(size));
+
+        for (size_t offset = 0; offset < size; offset += pageSize) {
+            buffer[offset] = char(i);
+        }
+        doNotOptimize(buffer);
+
+        store.free(buffer);
+    }
+}
+
+/**
+ * Allocates and frees a 32-byte item through myMalloc() and myFree(), which
+ * inline their fast paths.
+ */
+void mallocFreePair(size_t iterations) {
+    for (size_t i = 0; i < iterations; i++) {
+        void* ptr = myMalloc(32);
+        doNotOptimize(ptr);
+        myFree(ptr);
+    }
+}
+
+/**
+ * The same through the out-of-line paths myMalloc() and myFree() fall back to.
+ */
+void mallocFreePairSlow(size_t iterations) {
+    for (size_t i = 0; i < iterations; i++) {
+        void* ptr = myMallocSlow(32);
+        doNotOptimize(ptr);
+        myFreeSlow(ptr);
+    }
+}
+
+/**
+ * Counts the user space instructions retired by `benchmark` with a hardware
+ * counter, or returns -1 if perf_event_open() isn't available, as in many VMs
+ * and containers.
+ */
+long long countInstructions(void (*benchmark)(size_t), size_t iterations) {
+    perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.size = sizeof(attr);
+    attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+
+    int fd = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+    if (fd < 0) {
+        return -1;
+    }
+
+    ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+    ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+    benchmark(iterations);
+    ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+
+    long long count = -1;
+    if (read(fd, &count, sizeof(count)) != sizeof(count)) {
+        count = -1;
+    }
+    close(fd);
+    return count;
+}
+
+/**
+ * Prints how many instructions a malloc/free pair takes on the inlined fast
+ * paths and on the out-of-line ones.
+ */
+void printInstructionCounts() {
+    constexpr size_t pairs = 1'000'000;
+
+    const std::pair<void (*)(size_t), const char*> benchmarks[] = {
+        { mallocFreePair, "inline" },
+        { mallocFreePairSlow, "out-of-line" },
+    };
+
+    std::cout << "Instructions per 32-byte malloc/free pair:" << std::endl;
+    for (const auto& benchmark : benchmarks) {
+        // Warm up, so arenas are already made.
+        benchmark.first(pairs);
+
+        long long count = countInstructions(benchmark.first, pairs);
+        if (count < 0) {
+            std::cout << "unavailable: perf_event_open() failed: " << strerror(errno) << std::endl;
+            return;
+        }
+        std::cout << benchmark.second << "\t" << double(count) / pairs << std::endl;
+    }
+}
+
+/**
+ * Serves a mix of request sizes skewed towards small objects and prints how much
+ * of each size class's reserved space was actually requested.
+ */
+void printSizeClassReport() {
+    ArenaStore store;
+    srand(42);
+
+    for (size_t i = 0; i < 1'000'000; i++) {
+        size_t limit = size_t(8) << (rand() % 8);
+
+        store.free(store.alloc(rand() % limit + 1));
+    }
+
+    std::cout << "Size class report for 1000000 requests of up to 1024 bytes:" << std::endl;
+    store.report(std::cout);
+}
+
+/**
+ * Simulates a long-running process whose live set swells and shrinks: each round
+ * grows it to policyChurnPeak items of mixed small sizes, then frees a random 90%
+ * of them, replacing items at random throughout. Prints how many pages each
+ * ArenaPolicy mapped, how many it gave back to the OS as arenas emptied out, and
+ * how many were still mapped at the end.
+ */
+void printArenaPolicyReport() {
+    constexpr size_t policyChurnPeak = 200'000;
+    constexpr size_t policyChurnRounds = 20;
+
+    const std::pair<ArenaPolicy, const char*> policies[] = {
+        { ArenaPolicy::MostFull, "most-full" },
+        { ArenaPolicy::LowestAddress, "lowest-address" },
+        { ArenaPolicy::Newest, "newest" },
+    };
+
+    std::cout << "Arena policy report for " << policyChurnRounds << " rounds of up to "
+              << policyChurnPeak << " live items:" << std::endl;
+    std::cout << "policy\tmapped\treleased\tmapped at end" << std::endl;
+
+    for (const auto& policy : policies) {
+        ArenaStore store;
+        store.setArenaPolicy(policy.first);
+
+        std::vector<void*> live;
+        srand(42);
+
+        for (size_t round = 0; round < policyChurnRounds; round++) {
+            while (live.size() < policyChurnPeak) {
+                live.push_back(store.alloc(8 << (rand() % 6)));
+
+                size_t victim = rand() % live.size();
+                store.free(live[victim]);
+                live[victim] = store.alloc(8 << (rand() % 6));
+            }
+
+            for (size_t i = 0; i < live.size(); i++) {
+                if (rand() % 10 != 0) {
+                    store.free(live[i]);
+                    live[i] = live.back();
+                    live.pop_back();
+                    i--;
+                }
+            }
+        }
+
+        const auto& stats = store.arenaStats();
+        std::cout << policy.second
+                  << "\t" << stats.pagesMapped
+                  << "\t" << stats.pagesReleased
+                  << "\t" << stats.pagesMapped - stats.pagesReleased << std::endl;
+
+        for (auto ptr : live) {
+            store.free(ptr);
+        }
+    }
+}
+
+void runArenaBenchmarks() {
+    BenchmarkSuite suite;
+
+    BENCHMARK(suite, freeListChurn8, 10'000'000);
+    BENCHMARK(suite, bitmapChurn8, 10'000'000);
+    BENCHMARK(suite, freeListRandomReplace8, 1'000'000);
+    BENCHMARK(suite, bitmapRandomReplace8, 1'000'000);
+    BENCHMARK(suite, classRegionRandomReplace8, 1'000'000);
+    BENCHMARK(suite, bigAllocReuse, 100'000);
+    BENCHMARK(suite, mallocFreePair, 100'000'000);
+    BENCHMARK(suite, mallocFreePairSlow, 100'000'000);
+
+    suite.run();
+
+    printInstructionCounts();
+    printSizeClassReport();
+    printArenaPolicyReport();
+}
@@ -0,0 +1,10 @@
+#include <Benchmark.hpp>
+#include <ArenaBench.hpp>
+#include <ContainerBench.hpp>
+
+int benchMain(int argc, const char* argv[]) {
+    runArenaBenchmarks();
+    runContainerBenchmarks();
+
+    return 0;
+}
@@ -0,0 +1,33 @@
+#include <chrono>
+#include <iostream>
+#include <string>
+
+#include <Benchmark.hpp>
+
+Benchmark::Benchmark(const std::string& name, const std::function<void(size_t)> benchmark, size_t iterations):
+    m_name(name), m_benchmark(benchmark), m_iterations(iterations) { }
+
+const std::string& Benchmark::name() const { return m_name; }
+
+size_t Benchmark::iterations() const { return m_iterations; }
+
+void Benchmark::run() const { m_benchmark(m_iterations); }
+
+void BenchmarkSuite::run() {
+    for (auto benchmark : m_benchmarks) {
+        auto start = std::chrono::steady_clock::now();
+
+        benchmark.run();
+
+        auto end = std::chrono::steady_clock::now();
+        double ns = std::chrono::duration<double, std::nano>(end - start).count();
+
+        std::cout << "Benchmark " << benchmark.name() << ": "
+                  << ns / benchmark.iterations() << " ns/op over "
+                  << benchmark.iterations() << " iterations." << std::endl;
+    }
+}
+
+void BenchmarkSuite::add(const Benchmark& benchmark) {
+    m_benchmarks.push_back(benchmark);
+}
@@ -0,0 +1,127 @@
+#include <ArenaAllocator.hpp>
+#include <Benchmark.hpp>
+#include <ContainerBench.hpp>
+#include <cstdlib>
+#include <list>
+#include <map>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * The number of elements each container benchmark keeps live.
+ */
+constexpr size_t containerSize = 10'000;
+
+template <template <typename> class Allocator>
+using Map = std::map<int, int, std::less<int>, Allocator<std::pair<const int, int>>>;
+
+template <template <typename> class Allocator>
+using List = std::list<int, Allocator<int>>;
+
+template <template <typename> class Allocator>
+using UnorderedMap = std::unordered_map<int, int, std::hash<int>, std::equal_to<int>, Allocator<std::pair<const int, int>>>;
+
+/**
+ * Fills a map, then repeatedly erases a random key and inserts another, so
+ * nodes are freed and allocated in a scattered order.
+ */
+template <template <typename> class Allocator>
+void mapReplace(size_t iterations) {
+    Map<Allocator> map;
+    srand(42);
+
+    for (size_t i = 0; i < containerSize; i++) {
+        map[rand()] = int(i);
+    }
+
+    for (size_t i = 0; i < iterations; i++) {
+        auto victim = map.lower_bound(rand());
+        map.erase(victim == map.end() ? map.begin() : victim);
+        map[rand()] = int(i);
+    }
+
+    doNotOptimize(map.size());
+}
+
+/**
+ * Builds a list and tears it down again, over and over, as a work queue that
+ * fills and drains would.
+ */
+template <template <typename> class Allocator>
+void listFillDrain(size_t iterations) {
+    List<Allocator> list;
+
+    for (size_t i = 0; i < iterations; i += containerSize) {
+        for (size_t j = 0; j < containerSize; j++) {
+            list.push_back(int(j));
+        }
+        doNotOptimize(list.back());
+
+        while (!list.empty()) {
+            list.pop_front();
+        }
+    }
+}
+
+/**
+ * Fills a hash map, then repeatedly erases a random key and inserts another.
+ * The bucket array stays put, so this churns the nodes.
+ */
+template <template <typename> class Allocator>
+void unorderedMapReplace(size_t iterations) {
+    UnorderedMap<Allocator> map;
+    std::vector<int> keys(containerSize);
+    srand(42);
+
+    for (auto& key : keys) {
+        key = rand();
+        map[key] = 0;
+    }
+
+    for (size_t i = 0; i < iterations; i++) {
+        int& key = keys[rand() % containerSize];
+        map.erase(key);
+        key = rand();
+        map[key] = int(i);
+    }
+
+    doNotOptimize(map.size());
+}
+
+void stdMapReplace(size_t iterations) {
+    mapReplace<std::allocator>(iterations);
+}
+
+void arenaMapReplace(size_t iterations) {
+    mapReplace<ArenaAllocator>(iterations);
+}
+
+void stdListFillDrain(size_t iterations) {
+    listFillDrain<std::allocator>(iterations);
+}
+
+void arenaListFillDrain(size_t iterations) {
+    listFillDrain<ArenaAllocator>(iterations);
+}
+
+void stdUnorderedMapReplace(size_t iterations) {
+    unorderedMapReplace<std::allocator>(iterations);
+}
+
+void arenaUnorderedMapReplace(size_t iterations) {
+    unorderedMapReplace<ArenaAllocator>(iterations);
+}
+
+void runContainerBenchmarks() {
+    BenchmarkSuite suite;
+
+    BENCHMARK(suite, stdMapReplace, 1'000'000);
+    BENCHMARK(suite, arenaMapReplace, 1'000'000);
+    BENCHMARK(suite, stdListFillDrain, 10'000'000);
+    BENCHMARK(suite, arenaListFillDrain, 10'000'000);
+    BENCHMARK(suite, stdUnorderedMapReplace, 1'000'000);
+    BENCHMARK(suite, arenaUnorderedMapReplace, 1'000'000);
+
+    suite.run();
+}
@@ -0,0 +1,122 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <limits>
+#include <new>
+#include <type_traits>
+
+#include <Malloc.hpp>
+
+/**
+ * What ArenaAllocator::allocate_at_least() returns, shaped like C++23's
+ * std::allocation_result: the memory, and how many objects it can hold.
+ */
+template <typename Pointer>
+struct ArenaAllocation {
+    Pointer ptr;
+    size_t count;
+};
+
+/**
+ * A standard allocator over the allocator, for containers that take one:
+ *
+ *     std::map<int, Order, std::less<int>, ArenaAllocator<std::pair<const int, Order>>> orders;
+ *
+ * Memory comes from the calling thread's store through the inlined fast paths,
+ * and can be deallocated from any thread. The allocator has no state, so every
+ * instance equals every other whatever its value_type. It costs a container no
+ * space, containers may splice and swap between one another freely, and
+ * propagating it is always safe.
+ *
+ * Deallocation passes on the size and alignment, so the item's size class, and
+ * usually its arena, are known without the page map. Node containers, which
+ * allocate and free one node at a time, mostly free into the arena they are
+ * allocating from. Types aligned beyond minItemAlignment come from a size class
+ * whose items are all aligned, not from padded allocations.
+ */
+template <typename T>
+class ArenaAllocator {
+public:
+    using value_type = T;
+    using size_type = size_t;
+    using difference_type = ptrdiff_t;
+    using propagate_on_container_copy_assignment = std::true_type;
+    using propagate_on_container_move_assignment = std::true_type;
+    using propagate_on_container_swap = std::true_type;
+    using is_always_equal = std::true_type;
+
+    template <typename U>
+    struct rebind {
+        using other = ArenaAllocator<U>;
+    };
+
+    ArenaAllocator() noexcept = default;
+
+    template <typename U>
+    ArenaAllocator(const ArenaAllocator<U>&) noexcept {}
+
+    /**
+     * Allocates room for `n` objects. Throws std::bad_array_new_length if that's
+     * more than max_size(), and std::bad_alloc if the memory can't be had.
+     */
+    T* allocate(size_t n) {
+        if (n > max_size()) {
+            throw std::bad_array_new_length();
+        }
+
+        void* ptr = alignof(T) <= minItemAlignment ? myMalloc(n * sizeof(T))
+                                                   : myAlignedAlloc(alignof(T), n * sizeof(T));
+        if (ptr == nullptr) {
+            throw std::bad_alloc();
+        }
+        return static_cast<T*>(ptr);
+    }
+
+    /**
+     * Allocates room for at least `n` objects, and as many more as the size
+     * class or pages the allocation gets anyway can hold, like C++23's
+     * std::allocator::allocate_at_least(). Deallocate with the count returned,
+     * or anything between it and `n`.
+     */
+    ArenaAllocation<T*> allocate_at_least(size_t n) {
+        if (n > max_size()) {
+            throw std::bad_array_new_length();
+        }
+
+        void* ptr;
+        size_t bytes;
+        if (alignof(T) <= minItemAlignment) {
+            ptr = myMallocAtLeast(n * sizeof(T), &bytes);
+        } else {
+            ptr = myAlignedAlloc(alignof(T), n * sizeof(T));
+            bytes = myMallocUsableSize(ptr);
+        }
+
+        if (ptr == nullptr) {
+            throw std::bad_alloc();
+        }
+        return { static_cast<T*>(ptr), std::max(bytes / sizeof(T), n) };
+    }
+
+    /**
+     * Frees `ptr`, which was allocated with room for `n` objects.
+     */
+    void deallocate(T* ptr, size_t n) noexcept {
+        myFreeAlignedSized(ptr, alignof(T) <= minItemAlignment ? 1 : alignof(T), n * sizeof(T));
+    }
+
+    size_t max_size() const noexcept {
+        return std::numeric_limits<size_t>::max() / sizeof(T);
+    }
+
+    template <typename U>
+    bool operator==(const ArenaAllocator<U>&) const noexcept {
+        return true;
+    }
+
+    template <typename U>
+    bool operator!=(const ArenaAllocator<U>&) const noexcept {
+        return false;
+    }
+};
@@ -0,0 +1,473 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <sys/mman.h>
+
+#include <HugePages.hpp>
+#include <MetadataSlab.hpp>
+#include <Page.hpp>
+#include <PageMap.hpp>
+
+class Arena;
+class MMapObject;
+
+/**
+ * The address range that arena spans and most big allocations are carved from.
+ * Each page handed out is recorded in the PageMap against the MMapObject owning
+ * its span, and the PageMap entries at the ends of free runs describe the run.
+ *
+ * Keeping metadata out of the spans means every byte of a span holds data, and
+ * finding an item's arena is a lookup in the page map rather than a read of the
+ * data page's first cache line.
+ *
+ * The range is reserved inaccessible up front, so it costs address space but
+ * no memory, and it's made accessible a chunk at a time as spans are first
+ * handed out. The whole range is one mapping, so however many spans are live
+ * they cost a handful of VMAs and no syscalls beyond one mprotect per chunk.
+ * Released spans give their memory back to the OS with MADV_DONTNEED and are
+ * coalesced with free neighbours, so a run of freed small spans can serve a
+ * bigger one later.
+ *
+ * The range starts on a huge page boundary and chunks are whole huge pages, so
+ * with a HugePageMode set every chunk can be backed by huge pages. Spans are
+ * then reused best-fit before the range grows, which packs small spans into the
+ * huge pages already backed, and only whole free huge pages go back to the OS.
+ */
+class ArenaHeap {
+public:
+    // The number of bytes made accessible at a time.
+    static constexpr size_t chunkSize = size_t(64) << 20;
+
+    // The largest span the heap hands out. Bigger allocations get their own mmap.
+    static constexpr size_t maxSpanSize = chunkSize;
+
+private:
+    // The size of the reserved range. Arenas can't outgrow this; when they try,
+    // ArenaStore falls back to BigAlloc.
+    static constexpr size_t reservedSize = size_t(64) << 30;
+
+    static constexpr size_t numPages = reservedSize / pageSize;
+
+    static constexpr size_t chunkPages = chunkSize / pageSize;
+
+    // s_base before the range is reserved. Nothing a user can hold lies within
+    // reservedSize bytes of it, so contains() is false for every pointer.
+    static constexpr uintptr_t unreservedBase = UINTPTR_MAX - reservedSize;
+
+    // Marks a page map entry as pointing to a FreeRun rather than an MMapObject.
+    static constexpr uintptr_t freeRunTag = PageMap::freeTag;
+
+    // A run of free pages, merged from released spans. Its first and last pages'
+    // page map entries point to it, so releasing a neighbouring span can find it.
+    // It's dirty if any of its pages may still hold a released span's data.
+    struct FreeRun {
+        size_t first;
+        size_t pages;
+        FreeRun* prev;
+        FreeRun* next;
+        bool dirty;
+    };
+
+    // Free runs of 1 to maxSpanPages pages are binned by exact size; anything
+    // longer goes in bin 0.
+    static constexpr size_t numBins = maxSpanPages + 1;
+
+    static inline std::atomic<uintptr_t> s_base { unreservedBase };
+
+    // The page number of the first page in the range. In the PageMap, each page
+    // in the range maps to the MMapObject whose span covers it, or for the first
+    // and last pages of a free run, the FreeRun | freeRunTag. Pages inside a free
+    // run map to zero.
+    static inline uintptr_t s_basePage = 0;
+
+    // Guards everything below, along with reserving the range.
+    static inline std::mutex s_lock;
+
+    // Pages below this have been handed out at least once.
+    static inline size_t s_nextPage = 0;
+
+    // Pages below this are accessible. Always a whole number of chunks.
+    static inline size_t s_committedPages = 0;
+
+    static inline FreeRun* s_freeRuns[numBins] = {};
+
+    static size_t pageIndex(uintptr_t address) {
+        return (address - s_base.load(std::memory_order_relaxed)) / pageSize;
+    }
+
+    static uintptr_t pageAddress(size_t index) {
+        return s_base.load(std::memory_order_relaxed) + index * pageSize;
+    }
+
+    static uintptr_t entry(size_t index) {
+        return PageMap::get(s_basePage + index);
+    }
+
+    static void setEntries(size_t index, size_t count, uintptr_t value) {
+        // reserve() created the leaves for the whole range, so this can't fail.
+        PageMap::set(s_basePage + index, count, value);
+    }
+
+    static size_t binFor(size_t pages) {
+        return pages < numBins ? pages : 0;
+    }
+
+    /**
+     * Reserves the range and its page map leaves if we haven't yet. Called with
+     * s_lock held.
+     */
+    static bool reserve() {
+        if (s_base.load(std::memory_order_relaxed) != unreservedBase) {
+            return true;
+        }
+
+        char* range = HugePages::reserve(reservedSize);
+        if (range == nullptr) {
+            return false;
+        }
+
+        if (!PageMap::ensure(PageMap::pageOf(range), numPages)) {
+            munmap(range, reservedSize);
+            return false;
+        }
+
+        s_basePage = PageMap::pageOf(range);
+        s_base.store(reinterpret_cast<uintptr_t>(range), std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * Files `run` in its bin and points its boundary pages at it. Called with
+     * s_lock held.
+     */
+    static void insertRun(FreeRun* run) {
+        FreeRun*& bin = s_freeRuns[binFor(run->pages)];
+
+        run->prev = nullptr;
+        run->next = bin;
+        if (bin != nullptr) {
+            bin->prev = run;
+        }
+        bin = run;
+
+        uintptr_t tagged = reinterpret_cast<uintptr_t>(run) | freeRunTag;
+        setEntries(run->first, 1, tagged);
+        setEntries(run->first + run->pages - 1, 1, tagged);
+    }
+
+    /**
+     * Takes `run` out of its bin and clears its boundary pages. Called with
+     * s_lock held.
+     */
+    static void removeRun(FreeRun* run) {
+        if (run->prev != nullptr) {
+            run->prev->next = run->next;
+        } else {
+            s_freeRuns[binFor(run->pages)] = run->next;
+        }
+        if (run->next != nullptr) {
+            run->next->prev = run->prev;
+        }
+
+        setEntries(run->first, 1, 0);
+        setEntries(run->first + run->pages - 1, 1, 0);
+    }
+
+    /**
+     * The free run whose boundary is at page `index`, if there is one. Called
+     * with s_lock held.
+     */
+    static FreeRun* runAt(size_t index) {
+        uintptr_t tagged = entry(index);
+        return (tagged & freeRunTag) != 0 ? reinterpret_cast<FreeRun*>(tagged & ~freeRunTag) : nullptr;
+    }
+
+    static size_t alignUp(size_t index, size_t alignment) {
+        return (index + alignment - 1) / alignment * alignment;
+    }
+
+    /**
+     * Finds the smallest binned run that `pages` pages starting on a multiple of
+     * `alignment` pages fit in, or for requests past the exact bins, the first
+     * such run. Called with s_lock held.
+     */
+    static FreeRun* findRun(size_t pages, size_t alignment) {
+        auto fits = [&](FreeRun* run) {
+            return alignUp(run->first, alignment) + pages <= run->first + run->pages;
+        };
+
+        for (size_t bin = binFor(pages); bin != 0 && bin < numBins; bin++) {
+            for (FreeRun* run = s_freeRuns[bin]; run != nullptr; run = run->next) {
+                if (fits(run)) {
+                    return run;
+                }
+            }
+        }
+
+        for (FreeRun* run = s_freeRuns[0]; run != nullptr; run = run->next) {
+            if (fits(run)) {
+                return run;
+            }
+        }
+
+        return nullptr;
+    }
+
+    /**
+     * Files `pages` free pages starting at `first` as a run, merged with any free
+     * runs on either side, and dirty if they are or the merged runs were. Returns
+     * the merged run, or null if we're out of metadata, in which case the pages
+     * are lost to the heap. Called with s_lock held.
+     */
+    static FreeRun* addFreeRun(size_t first, size_t pages, bool dirty) {
+        FreeRun* run = nullptr;
+
+        FreeRun* before = first > 0 ? runAt(first - 1) : nullptr;
+        if (before != nullptr) {
+            removeRun(before);
+            before->pages += pages;
+            before->dirty |= dirty;
+            run = before;
+        }
+
+        FreeRun* after = first + pages < s_nextPage ? runAt(first + pages) : nullptr;
+        if (after != nullptr) {
+            removeRun(after);
+            if (run != nullptr) {
+                run->pages += after->pages;
+                run->dirty |= after->dirty;
+                MetadataSlab<FreeRun>::free(after);
+            } else {
+                after->first = first;
+                after->pages += pages;
+                after->dirty |= dirty;
+                run = after;
+            }
+        }
+
+        if (run == nullptr) {
+            run = MetadataSlab<FreeRun>::alloc();
+            if (run == nullptr) {
+                return nullptr;
+            }
+            run->first = first;
+            run->pages = pages;
+            run->dirty = dirty;
+        }
+
+        insertRun(run);
+        return run;
+    }
+
+    /**
+     * Takes `pages` pages starting on a multiple of `alignment` pages from a free
+     * run, or failing that from the untouched top of the range, making another
+     * chunk accessible if need be. Returns the index of the first page, or
+     * numPages if the range is exhausted, and sets `zeroed` to whether the pages
+     * are known to be zero. Called with s_lock held.
+     */
+    static size_t takePages(size_t pages, size_t alignment, bool& zeroed) {
+        FreeRun* run = findRun(pages, alignment);
+        if (run != nullptr) {
+            size_t first = alignUp(run->first, alignment);
+            size_t end = run->first + run->pages;
+            bool dirty = run->dirty;
+
+            zeroed = !dirty;
+
+            removeRun(run);
+            if (first > run->first) {
+                // Alignment left free pages in front. They keep the run.
+                run->pages = first - run->first;
+                insertRun(run);
+                run = first + pages < end ? MetadataSlab<FreeRun>::alloc() : nullptr;
+            }
+            if (first + pages < end) {
+                if (run != nullptr) {
+                    run->first = first + pages;
+                    run->pages = end - run->first;
+                    run->dirty = dirty;
+                    insertRun(run);
+                }
+            } else if (run != nullptr) {
+                MetadataSlab<FreeRun>::free(run);
+            }
+            return first;
+        }
+
+        size_t first = alignUp(s_nextPage, alignment);
+        if (first + pages > numPages) {
+            return numPages;
+        }
+
+        if (first + pages > s_committedPages) {
+            size_t committed = (first + pages + chunkPages - 1) / chunkPages * chunkPages;
+            if (!HugePages::commit(reinterpret_cast<char*>(pageAddress(s_committedPages)),
+                                   (committed - s_committedPages) * pageSize)) {
+                return numPages;
+            }
+            s_committedPages = committed;
+        }
+
+        size_t gap = s_nextPage;
+        s_nextPage = first + pages;
+        if (first > gap) {
+            addFreeRun(gap, first - gap, false);
+        }
+        zeroed = true;
+        return first;
+    }
+
+public:
+    /**
+     * Whether `ptr` lies in the heap's range, i.e. was handed out by an arena or a
+     * big allocation carved from the heap.
+     */
+    static bool contains(const void* ptr) {
+        return reinterpret_cast<uintptr_t>(ptr) - s_base.load(std::memory_order_acquire) < reservedSize;
+    }
+
+    /**
+     * How much of the heap's resident memory is backed by huge pages.
+     */
+    static HugePages::Coverage coverage() {
+        if (s_base.load(std::memory_order_acquire) == unreservedBase) {
+            return {};
+        }
+        return HugePages::coverage(reinterpret_cast<void*>(s_base.load(std::memory_order_relaxed)), reservedSize);
+    }
+
+    /**
+     * Returns the arena whose span holds `ptr`, which must be an arena item.
+     */
+    static Arena* arenaFor(const void* ptr) {
+        return reinterpret_cast<Arena*>(PageMap::get(PageMap::pageOf(ptr)));
+    }
+
+    /**
+     * Hands out a span of `pages` page-aligned pages owned by `owner`, or null if
+     * the range is exhausted. `pages` is at most maxSpanSize / pageSize, and the
+     * span starts on a multiple of `alignment` pages. The pages are zero unless
+     * they were released in units bigger than a page and some of a released
+     * span's data is left; if `zeroed` isn't null, it's set to whether they're
+     * known to be zero.
+     */
+    static char* allocSpan(size_t pages, const void* owner, size_t alignment = 1, bool* zeroed = nullptr) {
+        size_t first;
+        bool fresh;
+
+        {
+            std::lock_guard<std::mutex> guard(s_lock);
+
+            if (!reserve()) {
+                return nullptr;
+            }
+
+            first = takePages(pages, alignment, fresh);
+            if (first == numPages) {
+                return nullptr;
+            }
+        }
+
+        // The span is ours alone now, so its page map entries are too.
+        setEntries(first, pages, reinterpret_cast<uintptr_t>(owner));
+
+        if (zeroed != nullptr) {
+            *zeroed = fresh;
+        }
+        return reinterpret_cast<char*>(pageAddress(first));
+    }
+
+    /**
+     * Grows a span from allocSpan() of `pages` pages to `newPages` pages in place,
+     * taking the free pages right after it. Returns false, leaving the span as it
+     * was, if they aren't free.
+     */
+    static bool growSpan(char* span, size_t pages, size_t newPages, const void* owner) {
+        size_t end = pageIndex(reinterpret_cast<uintptr_t>(span)) + pages;
+        size_t extra = newPages - pages;
+
+        {
+            std::lock_guard<std::mutex> guard(s_lock);
+
+            FreeRun* run = end < s_nextPage ? runAt(end) : nullptr;
+            if (run != nullptr && run->first == end && run->pages >= extra) {
+                removeRun(run);
+                if (run->pages > extra) {
+                    run->first += extra;
+                    run->pages -= extra;
+                    insertRun(run);
+                } else {
+                    MetadataSlab<FreeRun>::free(run);
+                }
+            } else if (end == s_nextPage && end + extra <= numPages) {
+                if (end + extra > s_committedPages) {
+                    size_t committed = (end + extra + chunkPages - 1) / chunkPages * chunkPages;
+                    if (!HugePages::commit(reinterpret_cast<char*>(pageAddress(s_committedPages)),
+                                           (committed - s_committedPages) * pageSize)) {
+                        return false;
+                    }
+                    s_committedPages = committed;
+                }
+                s_nextPage += extra;
+            } else {
+                return false;
+            }
+        }
+
+        setEntries(end, extra, reinterpret_cast<uintptr_t>(owner));
+        return true;
+    }
+
+    /**
+     * Returns a span from allocSpan() to the heap. Its memory goes back to the OS,
+     * or if that happens in units bigger than a page (huge pages, or an OS page
+     * bigger than ours), whichever units it leaves wholly free do, and its pages
+     * join any free pages on either side.
+     */
+    static void releaseSpan(char* span, size_t pages) {
+        // With page sized granules, the span goes back before taking the lock.
+        bool wholeSpan = HugePages::releaseGranule() == pageSize;
+        bool zeroed = wholeSpan && HugePages::release(span, pages * pageSize, span, span + pages * pageSize);
+
+        size_t first = pageIndex(reinterpret_cast<uintptr_t>(span));
+        setEntries(first, pages, 0);
+
+        std::lock_guard<std::mutex> guard(s_lock);
+
+        if (!wholeSpan) {
+            // Under the lock, so nobody can have taken the pages back yet. The
+            // span can go back along with the free runs either side, and the
+            // untouched top of the range.
+            FreeRun* before = first > 0 ? runAt(first - 1) : nullptr;
+            FreeRun* after = first + pages < s_nextPage ? runAt(first + pages) : nullptr;
+            size_t lower = before != nullptr ? before->first : first;
+            size_t upper = after != nullptr ? after->first + after->pages : first + pages;
+            if (upper == s_nextPage) {
+                upper = s_committedPages;
+            }
+            zeroed = HugePages::release(span, pages * pageSize, reinterpret_cast<char*>(pageAddress(lower)),
+                                        reinterpret_cast<char*>(pageAddress(upper)));
+        }
+
+        // Memory madvise() failed to give back keeps its contents.
+        addFreeRun(first, pages, !zeroed);
+    }
+
+    /**
+     * Takes the heap's lock ahead of fork(), and with it the lock of the slab
+     * holding the free runs, so the child doesn't inherit either mid-update.
+     */
+    static void lockForFork() {
+        s_lock.lock();
+        MetadataSlab<FreeRun>::lockForFork();
+    }
+
+    static void unlockAfterFork() {
+        MetadataSlab<FreeRun>::unlockAfterFork();
+        s_lock.unlock();
+    }
+};
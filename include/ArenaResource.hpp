@@ -0,0 +1,51 @@
+#pragma once
+
+#include <memory_resource>
+#include <new>
+
+#include <Malloc.hpp>
+
+/**
+ * A std::pmr::memory_resource over the allocator, for pointing individual pmr
+ * containers at it:
+ *
+ *     std::pmr::vector<int> values(arenaResource());
+ *
+ * Memory comes from the calling thread's store, through the same inlined fast
+ * paths as myMalloc() and myFree(), except that alignments beyond
+ * minItemAlignment go through the out-of-line myAlignedAlloc(). Memory can be
+ * deallocated from any thread. Deallocation passes on the size and alignment
+ * that pmr hands back, so the item's size class, and usually its arena, are
+ * known without the page map.
+ *
+ * The resource holds no state, so every ArenaResource compares equal to every
+ * other.
+ */
+class ArenaResource : public std::pmr::memory_resource {
+protected:
+    void* do_allocate(size_t bytes, size_t alignment) override {
+        void* ptr = alignment <= minItemAlignment ? myMalloc(bytes) : myAlignedAlloc(alignment, bytes);
+        if (ptr == nullptr) {
+            throw std::bad_alloc();
+        }
+        return ptr;
+    }
+
+    void do_deallocate(void* ptr, size_t bytes, size_t alignment) override {
+        myFreeAlignedSized(ptr, alignment, bytes);
+    }
+
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override {
+        return this == &other || dynamic_cast<const ArenaResource*>(&other) != nullptr;
+    }
+};
+
+/**
+ * The process's ArenaResource, like std::pmr::new_delete_resource(). It's never
+ * destroyed, so containers using it may outlive static destructors.
+ */
+inline ArenaResource* arenaResource() {
+    alignas(ArenaResource) static char storage[sizeof(ArenaResource)];
+    static ArenaResource* resource = new (storage) ArenaResource();
+    return resource;
+}
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+// Helpers for scanning occupancy bitmaps stored as arrays of 64-bit words.
+// A set bit means "free", so finding a slot is finding the first set bit.
+// Words may be plain or atomic; atomic words are read with relaxed loads.
+
+inline uint64_t loadWord(const uint64_t& word) {
+    return word;
+}
+
+inline uint64_t loadWord(const std::atomic<uint64_t>& word) {
+    return word.load(std::memory_order_relaxed);
+}
+
+#if defined(__x86_64__)
+/**
+ * Whether the CPU we're running on supports AVX2. Resolved once at startup.
+ */
+inline const bool s_hasAvx2 = __builtin_cpu_supports("avx2");
+
+/**
+ * Returns the index of the first non-zero word in `words`, or `count` if they're
+ * all zero. Skips empty runs 256 bits at a time. The vector loads aren't atomic,
+ * so this is only for plain words.
+ */
+__attribute__((target("avx2")))
+inline size_t findNonZeroWordAvx2(const uint64_t* words, size_t count) {
+    size_t i = 0;
+
+    for (; i + 4 <= count; i += 4) {
+        __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(words + i));
+        if (!_mm256_testz_si256(block, block)) {
+            break;
+        }
+    }
+
+    for (; i < count; i++) {
+        if (words[i] != 0) {
+            return i;
+        }
+    }
+
+    return count;
+}
+#endif
+
+/**
+ * Returns the index of the first non-zero word in `words`, or `count` if they're
+ * all zero. Plain bitmaps of at least four words are scanned with AVX2 when
+ * available; atomic ones, which other threads may be setting bits in, a word at
+ * a time.
+ */
+template<typename Word>
+inline size_t findNonZeroWord(const Word* words, size_t count) {
+#if defined(__x86_64__)
+    if constexpr (std::is_same_v<Word, uint64_t>) {
+        if (count >= 4 && s_hasAvx2) {
+            return findNonZeroWordAvx2(words, count);
+        }
+    }
+#endif
+
+    for (size_t i = 0; i < count; i++) {
+        if (loadWord(words[i]) != 0) {
+            return i;
+        }
+    }
+
+    return count;
+}
+
+/**
+ * Returns the number of set bits across `count` words.
+ */
+template<typename Word>
+inline size_t countSetBits(const Word* words, size_t count) {
+    size_t total = 0;
+
+    for (size_t i = 0; i < count; i++) {
+        total += __builtin_popcountll(loadWord(words[i]));
+    }
+
+    return total;
+}
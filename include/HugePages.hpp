@@ -0,0 +1,241 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <sys/mman.h>
+
+#include <Page.hpp>
+
+// The size of a huge page, on x86-64 and on arm64 with 4 KiB pages.
+constexpr size_t hugePageSize = size_t(2) << 20;
+
+/**
+ * How the allocator's mappings use huge pages.
+ *
+ * Off: plain pages, and freed memory goes back to the OS a page at a time.
+ *
+ * Transparent: reservations are huge page aligned and committed memory is
+ * advised with MADV_HUGEPAGE, so the kernel can back it with transparent huge
+ * pages. Freed memory only goes back to the OS a whole huge page at a time, so
+ * a freed span doesn't split the huge page it sits in.
+ *
+ * Explicit: as Transparent, but memory is committed with MAP_HUGETLB from the
+ * preallocated huge page pool (vm.nr_hugepages), falling back to Transparent
+ * when the pool can't cover it.
+ *
+ * The mode is process-wide and meant to be set once, before the first
+ * allocation; memory committed earlier keeps the pages it got.
+ */
+enum class HugePageMode : uint8_t {
+    Off,
+    Transparent,
+    Explicit
+};
+
+/**
+ * Reserving, committing and releasing the allocator's address ranges according
+ * to the HugePageMode, and measuring how much of them huge pages back.
+ */
+class HugePages {
+    static inline std::atomic<HugePageMode> s_mode { HugePageMode::Off };
+
+    static uintptr_t roundUp(uintptr_t value, size_t alignment) {
+        return (value + alignment - 1) & ~(alignment - 1);
+    }
+
+    static uintptr_t roundDown(uintptr_t value, size_t alignment) {
+        return value & ~(alignment - 1);
+    }
+
+public:
+    static HugePageMode mode() {
+        return s_mode.load(std::memory_order_relaxed);
+    }
+
+    static void setMode(HugePageMode mode) {
+        s_mode.store(mode, std::memory_order_relaxed);
+    }
+
+    static bool enabled() {
+        return mode() != HugePageMode::Off;
+    }
+
+    /**
+     * Reserves `size` bytes of inaccessible address space starting on a multiple
+     * of `alignment`, a power of two no smaller than the OS page, and by default a
+     * huge page boundary. `size` must be a multiple of the OS page. Returns null on
+     * failure.
+     */
+    static char* reserve(size_t size, size_t alignment = hugePageSize) {
+        void* range = mmap(nullptr, size + alignment, PROT_NONE, MAP_ANONYMOUS | MAP_PRIVATE | MAP_NORESERVE, -1, 0);
+        if (range == MAP_FAILED) {
+            return nullptr;
+        }
+
+        // Trim the misaligned head and whatever's left past the end.
+        uintptr_t start = reinterpret_cast<uintptr_t>(range);
+        uintptr_t aligned = roundUp(start, alignment);
+        if (aligned != start) {
+            munmap(range, aligned - start);
+        }
+        munmap(reinterpret_cast<void*>(aligned + size), start + alignment - aligned);
+
+        return reinterpret_cast<char*>(aligned);
+    }
+
+    /**
+     * Makes `size` bytes at `start`, part of a range from reserve(), accessible.
+     * Both must be multiples of hugePageSize when huge pages are enabled.
+     */
+    static bool commit(char* start, size_t size) {
+        HugePageMode current = mode();
+
+        if (current == HugePageMode::Explicit) {
+            void* mapped = mmap(start, size, PROT_READ | PROT_WRITE,
+                                MAP_ANONYMOUS | MAP_PRIVATE | MAP_FIXED | MAP_HUGETLB, -1, 0);
+            if (mapped != MAP_FAILED) {
+                return true;
+            }
+
+            // A failed MAP_FIXED may already have unmapped the range, so map it
+            // afresh rather than mprotect it.
+            mapped = mmap(start, size, PROT_READ | PROT_WRITE, MAP_ANONYMOUS | MAP_PRIVATE | MAP_FIXED, -1, 0);
+            if (mapped == MAP_FAILED) {
+                return false;
+            }
+        } else if (mprotect(start, size, PROT_READ | PROT_WRITE) != 0) {
+            return false;
+        }
+
+        if (current != HugePageMode::Off) {
+            madvise(start, size, MADV_HUGEPAGE);
+        }
+        return true;
+    }
+
+    /**
+     * The unit memory goes back to the OS in: a huge page with huge pages
+     * enabled, otherwise an OS page.
+     */
+    static size_t releaseGranule() {
+        return enabled() ? hugePageSize : std::max(systemPageSize(), pageSize);
+    }
+
+    /**
+     * Gives the memory behind `size` bytes at `start` back to the OS, leaving it
+     * accessible. If the release granule is bigger than pageSize, only granules
+     * lying wholly within [`lower`, `upper`) and overlapping the range are given
+     * back; the caller passes the bounds of the free memory around the range.
+     * Returns whether all of the range went back, so reads as zero. It didn't if
+     * madvise() failed, as MADV_DONTNEED does on MAP_HUGETLB memory before Linux
+     * 5.18.
+     */
+    static bool release(char* start, size_t size, char* lower, char* upper) {
+        size_t granule = releaseGranule();
+        if (granule == pageSize) {
+            return madvise(start, size, MADV_DONTNEED) == 0;
+        }
+
+        uintptr_t first = std::max(roundDown(reinterpret_cast<uintptr_t>(start), granule),
+                                   roundUp(reinterpret_cast<uintptr_t>(lower), granule));
+        uintptr_t last = std::min(roundUp(reinterpret_cast<uintptr_t>(start + size), granule),
+                                  roundDown(reinterpret_cast<uintptr_t>(upper), granule));
+        if (first >= last) {
+            return false;
+        }
+
+        if (madvise(reinterpret_cast<void*>(first), last - first, MADV_DONTNEED) != 0) {
+            return false;
+        }
+        return first <= reinterpret_cast<uintptr_t>(start) && last >= reinterpret_cast<uintptr_t>(start + size);
+    }
+
+    /**
+     * The length of the mapping map() makes for `size` bytes.
+     */
+    static size_t mappingSize(size_t size) {
+        size_t alignment = enabled() && size >= hugePageSize ? hugePageSize : std::max(systemPageSize(), pageSize);
+        return roundUp(size, alignment);
+    }
+
+    /**
+     * Maps `size` bytes of fresh, accessible memory on its own, aligned to
+     * `alignment`, a power of two. With huge pages enabled, mappings of at least
+     * hugePageSize are huge page aligned and sized. Returns null on failure. Unmap
+     * with munmap() and mappingSize(size).
+     */
+    static char* map(size_t size, size_t alignment = pageSize) {
+        size_t length = mappingSize(size);
+
+        if (enabled() && length >= hugePageSize) {
+            alignment = std::max(alignment, hugePageSize);
+        } else if (alignment <= systemPageSize()) {
+            void* ptr = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+            return ptr != MAP_FAILED ? static_cast<char*>(ptr) : nullptr;
+        }
+
+        char* start = reserve(length, alignment);
+        if (start == nullptr) {
+            return nullptr;
+        }
+        if (!commit(start, length)) {
+            munmap(start, length);
+            return nullptr;
+        }
+        return start;
+    }
+
+    /**
+     * How much of a range's resident memory huge pages back.
+     */
+    struct Coverage {
+        size_t residentBytes;
+        size_t hugeBytes;
+    };
+
+    /**
+     * Adds up, from /proc/self/smaps, the resident and huge page backed memory of
+     * the mappings overlapping `size` bytes at `start`. Explicit huge pages count
+     * as both. Reads nothing and returns zeros where smaps isn't available.
+     */
+    static Coverage coverage(const void* start, size_t size) {
+        Coverage result = {};
+
+        FILE* smaps = fopen("/proc/self/smaps", "r");
+        if (smaps == nullptr) {
+            return result;
+        }
+
+        uintptr_t lower = reinterpret_cast<uintptr_t>(start);
+        uintptr_t upper = lower + size;
+        bool inRange = false;
+        char line[512];
+
+        while (fgets(line, sizeof(line), smaps) != nullptr) {
+            unsigned long from;
+            unsigned long to;
+            size_t kiB;
+
+            // Each mapping starts with a "from-to perms ..." line, followed by
+            // its "Field: value kB" lines.
+            if (sscanf(line, "%lx-%lx ", &from, &to) == 2) {
+                inRange = from < upper && to > lower;
+            } else if (!inRange) {
+                continue;
+            } else if (sscanf(line, "Rss: %zu kB", &kiB) == 1) {
+                result.residentBytes += kiB << 10;
+            } else if (sscanf(line, "AnonHugePages: %zu kB", &kiB) == 1) {
+                result.hugeBytes += kiB << 10;
+            } else if (sscanf(line, "Private_Hugetlb: %zu kB", &kiB) == 1) {
+                result.residentBytes += kiB << 10;
+                result.hugeBytes += kiB << 10;
+            }
+        }
+
+        fclose(smaps);
+        return result;
+    }
+};
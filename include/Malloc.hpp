@@ -3,14 +3,22 @@
 using namespace std;
 
 #include <signal.h>
+#include <array>
 #include <atomic>
+#include <algorithm>
+#include <cstring>
+#include <ctime>
 #include <iostream>
+#include <mutex>
+#include <new>
 #include <sys/mman.h>
 
-// You can assume this as your page size. On some OSs (e.g. macOS), 
-// it may in fact be larger and you'll waste memory due to internal 
-// fragmentation as a result, but that's okay for this exercise.
-constexpr size_t pageSize = 4096;
+#include <ArenaHeap.hpp>
+#include <Bitmap.hpp>
+#include <HugePages.hpp>
+#include <MetadataSlab.hpp>
+#include <Page.hpp>
+#include <PageMap.hpp>
 
 class MMapObject {
     // The size of the allocated contiguous pages (i.e. the size passed to mmap)
@@ -20,10 +28,43 @@ class MMapObject {
     // should be zero.
     size_t m_arenaSize;
 
+protected:
     // Debug counter for asserting we freed all the pages we were supposed to.
     // Thread safe and you can ignore it. It's for tests and seeing how many
     // outstanding pages there are.
     static std::atomic<size_t> s_outstandingPages;
+
+    /**
+     * Records that a set of pages counted in s_outstandingPages was given back.
+     */
+    static void releasedPages() {
+        size_t old = s_outstandingPages--;
+
+        // If there previously 0 pages, then we goofed and tried to free more pages
+        // than we allocated. This is a serious bug, so sigtrap and your debugger
+        // can break on this line. If not debugging, you'll get a SIGTRAP message
+        // and your program will exit.
+        if (old == 0) {
+            raise(SIGTRAP);
+        }
+    }
+
+    /**
+     * Marks an MMapObject whose descriptor outlives its memory as unused.
+     */
+    void clear() {
+        m_mmapSize = 0;
+        m_arenaSize = 0;
+    }
+
+    /**
+     * Sets the fields of an MMapObject overlaid onto raw memory.
+     */
+    void init(size_t mmapSize, size_t arenaSize) {
+        m_mmapSize = mmapSize;
+        m_arenaSize = arenaSize;
+    }
+
 public:
     MMapObject(const MMapObject& other) = delete;
     MMapObject() = delete;
@@ -44,53 +85,19 @@ public:
     }
 
     /**
-     * This function should call mmap to allocate a contiguous set of pages with
-     * the passed size. If the caller is intending to use this region as an arena,
-     * they should set arenaSize to the size of its items.
-     * 
-     * If this is a large allocation, the caller should set arenaSize to 0.
+     * Returns the MMapObject describing the memory at `ptr`, found through the
+     * PageMap or SizeClassRegions, or null if `ptr` isn't in memory we handed
+     * out. Every page of an arena's span maps to its Arena; a big allocation is
+     * found from its first page, which is what BigAlloc::alloc() returns.
      */
-    static MMapObject* alloc(size_t size, size_t arenaSize) 
-    {
-        void* ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_ANONYMOUS | MAP_PRIVATE, 0, 0);
-        if (ptr == MAP_FAILED)
-        {
-            return nullptr;
-        }
-        MMapObject* obj = (MMapObject*)ptr;
-        obj->m_mmapSize = size;
-        obj->m_arenaSize = arenaSize;
-        s_outstandingPages++;
-        return obj;
-    }
+    static MMapObject* find(const void* ptr);
 
     /**
-     * This function should deallocate the passed pointer by calling munmap.
-     * The passed pointer may not be at the start of the memory region, but will
-     * be withing it, so you'll need to calculate the start of the MMapObject* ptr,
-     * passing that as start of the region to unmap and ptr->mmapSize() as its length.
-     * 
-     * Recall that Arenas will never be larger than the OS page size and BigAllocs
-     * always return a pointer to just after the MMapObject header, so you can
-     * jump back to the nearest multiple of page size and that will be the MMapObject*.
+     * Deallocates the big allocation at the passed pointer, which must be a
+     * pointer returned by BigAlloc::alloc(). Arenas are released with
+     * Arena::destroy() instead.
      */
-    static void dealloc(void* obj) {
-        uintptr_t n = reinterpret_cast<uintptr_t>(obj); 
-        uintptr_t remainder = n % pageSize;
-        n = n - remainder;
-        MMapObject* map = reinterpret_cast<MMapObject*>(n);
-        int ret = munmap(map, map->mmapSize());
-
-        size_t old = s_outstandingPages--;
-
-        // If there previously 0 pages, then we goofed and tried to free more pages
-        // than we allocated. This is a serious bug, so sigtrap and your debugger
-        // can break on this line. If not debugging, you'll get a SIGTRAP message
-        // and your program will exit.
-        if (old == 0) {
-            raise(SIGTRAP);
-        }
-    }
+    static void dealloc(void* ptr);
 
     /**
      * Returns the number of pages outstanding that have not been collected.
@@ -103,304 +110,2730 @@ public:
 
 class BigAlloc : public MMapObject {
     // This inherits from MMapObject, so it also has the mmapSize and arenSize
-    // members as well.
+    // members as well. mmapSize is the size that was requested.
+    //
+    // Like an arena's, a BigAlloc's metadata lives in a MetadataSlab rather than
+    // in front of its data, and it's found through the PageMap.
 
-    char m_data[0];
+    friend class BigAllocCache;
 
-public:
-    BigAlloc(const BigAlloc& other) = delete;
-    BigAlloc() = delete;
+    // The first page of the allocation.
+    char* m_data;
+
+    // While the allocation sits in a BigAllocCache, its neighbours in its
+    // bucket, newest first, and when it was cached.
+    BigAlloc* m_cacheNext;
+    BigAlloc* m_cachePrev;
+    uint64_t m_cachedAt;
 
     /**
-     * This method should allocate a single large contiguous block of memory using
-     * MMapObject::alloc(). You then need to treat that pointer as a BigAlloc*
-     * and return the address of the allocation *after* the header.
-     * 
-     * The returned address must be 64-bit aligned.
+     * The number of pages the allocation spans.
      */
-    static void* alloc(size_t size) {
-        size_t fullSize = size + sizeof(BigAlloc);
-        void* ptr = MMapObject::alloc(fullSize, 0);
-        BigAlloc* obj = (BigAlloc*)ptr;
-        return &obj->m_data[0];
+    size_t pages() {
+        return pagesFor(mmapSize());
     }
-};
-
-// This is the data overlay for your Arena allocator.
-// It inherits from MMapObject, and thus has a size_
-class Arena : public MMapObject {
-    // This inherits from MMapObject, so it also has the mmapSize and arenaSize
-    // members as well.
 
-    // You'll need some means of tracking the number of freed items in this arena
-    // in a thread-safe manner. That should go here.
-    std::atomic<size_t> freedItems;
-    std::atomic<size_t> totalSpaceUsed;
-    std::atomic<size_t> totalSpaceUsedNoHeader;
+    /**
+     * Gives the allocation's pages back to ArenaHeap or the OS, and recycles the
+     * descriptor, without counting it against the outstanding pages.
+     */
+    static void release(BigAlloc* obj) {
+        size_t pages = obj->pages();
 
-    // A pointer to the next free address in the arena.
-    char* m_next;
+        if (ArenaHeap::contains(obj->m_data))
+        {
+            ArenaHeap::releaseSpan(obj->m_data, pages);
+        }
+        else
+        {
+            PageMap::set(PageMap::pageOf(obj->m_data), 1, 0);
+            munmap(obj->m_data, HugePages::mappingSize(pages * pageSize));
+        }
 
-    // This might look kind of weird as it's size is zero, but this serves as a surrogate
-    // location to start of the arena's allocation slots. That is &this->m_data[0] is a pointer
-    // to the first allocation slot, &this->m_data[arenaSize()] is a pointer to the second
-    // and so forth.
-    //
-    // Note, if you put any data members in this class, you must put them *before* this.
-    // Additionally, you need to ensure this address is 64-bit aligned, so you need appropriate
-    // padding or to ensure the sizes of your previous members ensures this happens before this.
-    //
-    // If sizeof(Arena) % 8 == 0, you should be good.
-    char m_data[0];
+        MetadataSlab<BigAlloc>::free(obj);
+    }
 
 public:
+    BigAlloc(const BigAlloc& other) = delete;
+    BigAlloc() = delete;
+
     /**
-     * Creates an arena with items of the given size. You should allocate with
-     * MMapObject::alloc() and coerce the result into an Arena*.
+     * The largest allocation BigAlloc will try to make. Nothing bigger could be
+     * mapped anyway, and sizes near SIZE_MAX would wrap when rounded up to pages.
      */
-    static Arena* create(uint32_t itemSize) {
-        void* ptr = MMapObject::alloc(pageSize, itemSize);
-        Arena* obj = (Arena*)ptr;
-        obj->m_next = &obj->m_data[0];
-        obj->totalSpaceUsed = sizeof(Arena);
-        if (sizeof(obj) % 8 != 0)
-        {
-            raise(SIGTRAP);
-        }
-        return obj;
+    static constexpr size_t maxSize = PTRDIFF_MAX;
+
+    /**
+     * Allocations of at least this size get a mapping of their own, so resize()
+     * can grow them with mremap() however big they get, rather than have realloc
+     * copy them once the pages after them are taken. Smaller ones are carved from
+     * ArenaHeap.
+     */
+    static constexpr size_t minMappedSize = 2 * hugePageSize;
+
+    /**
+     * The number of pages an allocation of `size` bytes, at most maxSize, spans.
+     */
+    static size_t pagesFor(size_t size) {
+        return std::max<size_t>((size + pageSize - 1) / pageSize, 1);
     }
 
     /**
-     * Allocates an item in the arena and returns its address. Returns null if you
-     * have already exceeded the bounds of the arena.
+     * Allocates a single large contiguous block of memory and returns its address,
+     * which is page aligned. Blocks smaller than minMappedSize are carved from
+     * ArenaHeap, so they don't each cost an mmap and a VMA. Bigger ones, or any
+     * once the heap is exhausted, get their own mmap, and only their first page is
+     * recorded in the PageMap. With huge pages enabled, blocks of at least
+     * hugePageSize are huge page aligned so they can be backed by huge pages from
+     * their first byte. The block is aligned to `alignment` too, if that's a
+     * bigger power of two. If `zeroed` isn't null, it's set to whether the block
+     * is known to be zero. Returns null if we're out of memory, or `size` or
+     * `alignment` is bigger than maxSize.
      */
-    void* alloc() {
-        if (this->full() != true)
+    static void* alloc(size_t size, size_t alignment = pageSize, bool* zeroed = nullptr) {
+        if (size > maxSize || alignment > maxSize)
+        {
+            return nullptr;
+        }
+
+        BigAlloc* obj = MetadataSlab<BigAlloc>::alloc();
+        if (obj == nullptr)
+        {
+            return nullptr;
+        }
+
+        size_t pages = pagesFor(size);
+        char* data = nullptr;
+        if (pages * pageSize < minMappedSize && alignment <= ArenaHeap::maxSpanSize)
+        {
+            size_t spanAlignment = HugePages::enabled() && size >= hugePageSize ? hugePageSize : pageSize;
+            data = ArenaHeap::allocSpan(pages, obj, std::max(spanAlignment, alignment) / pageSize, zeroed);
+        }
+
+        if (data == nullptr)
         {
-            char* temp = this->m_next;
-            totalSpaceUsed += arenaSize();
-            totalSpaceUsedNoHeader += arenaSize();
+            // Fresh mappings are always zero.
+            if (zeroed != nullptr)
+            {
+                *zeroed = true;
+            }
+
+            data = HugePages::map(pages * pageSize, alignment);
+            if (data == nullptr)
+            {
+                MetadataSlab<BigAlloc>::free(obj);
+                return nullptr;
+            }
 
-            this->m_next = &this->m_data[totalSpaceUsed.load()];
-            if (temp == nullptr)
+            if (!PageMap::set(PageMap::pageOf(data), 1, reinterpret_cast<uintptr_t>(obj)))
             {
-                raise(SIGTRAP);
+                munmap(data, HugePages::mappingSize(pages * pageSize));
+                MetadataSlab<BigAlloc>::free(obj);
+                return nullptr;
             }
-            return temp;
         }
-        return nullptr;
+
+        obj->init(size, 0);
+        obj->m_data = data;
+        s_outstandingPages++;
+        return data;
     }
 
     /**
-     * Marks one of the items in the arena as freed. Returns true if this arena
-     * has no more allocation slots and everything is free'd.
+     * Gives the allocation's pages back to ArenaHeap or the OS, and recycles the
+     * descriptor.
      */
-    bool free() {
-        freedItems++;
-        if (freedItems.load() == (totalSpaceUsedNoHeader.load() / arenaSize()) && full())
-        {
-            return true;
-        }
-        return false;
+    static void free(BigAlloc* obj) {
+        release(obj);
+        releasedPages();
     }
 
     /**
-     * Whether or not this arena can hold more items.
+     * Resizes the allocation to `size` bytes without copying it, and returns
+     * whether that worked. Shrinking gives the tail pages back, though a huge page
+     * mapping only shrinks by whole huge pages. Growing takes the free pages after
+     * an allocation carved from ArenaHeap, up to minMappedSize, and remaps one
+     * with a mapping of its own, which may move it. Either way data() is up to
+     * date. Sizes bigger than maxSize never fit.
      */
-    bool full() {
-        if (totalSpaceUsed.load() + arenaSize() > pageSize)
+    static bool resize(BigAlloc* obj, size_t size) {
+        if (size > maxSize)
         {
-            return true;
+            return false;
         }
-        return false;
+
+        size_t pages = obj->pages();
+        size_t newPages = pagesFor(size);
+
+        if (ArenaHeap::contains(obj->m_data))
+        {
+            if (newPages < pages)
+            {
+                ArenaHeap::releaseSpan(obj->m_data + newPages * pageSize, pages - newPages);
+            }
+            else if (newPages > pages &&
+                     (newPages * pageSize >= minMappedSize ||
+                      !ArenaHeap::growSpan(obj->m_data, pages, newPages, obj)))
+            {
+                return false;
+            }
+        }
+        else
+        {
+            size_t length = HugePages::mappingSize(pages * pageSize);
+            size_t newLength = HugePages::mappingSize(newPages * pageSize);
+
+            if (newLength < length)
+            {
+                // A huge page mapping, which may be MAP_HUGETLB, only comes apart
+                // on huge page boundaries. One shrinking below a huge page moves
+                // instead, as its size would no longer account for its mapping.
+                if (HugePages::enabled() && length >= hugePageSize && newLength % hugePageSize != 0)
+                {
+                    return false;
+                }
+                if (munmap(obj->m_data + newLength, length - newLength) != 0)
+                {
+                    return false;
+                }
+            }
+            else if (newLength > length)
+            {
+                void* moved = mremap(obj->m_data, length, newLength, MREMAP_MAYMOVE);
+                if (moved == MAP_FAILED)
+                {
+                    return false;
+                }
+
+                if (moved != obj->m_data)
+                {
+                    if (!PageMap::set(PageMap::pageOf(moved), 1, reinterpret_cast<uintptr_t>(obj)))
+                    {
+                        // Put it back where the page map can find it.
+                        mremap(moved, newLength, length, MREMAP_MAYMOVE | MREMAP_FIXED, obj->m_data);
+                        return false;
+                    }
+                    PageMap::set(PageMap::pageOf(obj->m_data), 1, 0);
+                    obj->m_data = static_cast<char*>(moved);
+                }
+            }
+        }
+
+        obj->init(size, 0);
+        return true;
     }
 
     /**
-     * Returns a pointer to the next free item in the arena.
+     * Returns a pointer to the allocation.
      */
-    char* next() {
-        return m_next;
+    char* data() {
+        return m_data;
     }
 };
-class ArenaStore {
+
+inline void MMapObject::dealloc(void* ptr) {
+    BigAlloc::free(static_cast<BigAlloc*>(find(ptr)));
+}
+
+/**
+ * Recently freed big allocations, kept whole and still mapped so a repeat
+ * allocation of the same size is served without taking the heap's lock, without
+ * MADV_DONTNEED on the way out and without page faults on the way back in.
+ *
+ * Allocations are bucketed by page count, and each bucket hands out its most
+ * recently freed allocation first, as that's the likeliest to still be warm.
+ * The cache holds at most a fixed number of bytes; past that, and for anything
+ * cached longer than maxAge, the oldest allocations are evicted to the overflow
+ * cache if there is one, or freed for real.
+ *
+ * Each ArenaStore has a cache of its own, overflowing into the process-wide
+ * global() cache, which is locked. Cached allocations don't count as
+ * outstanding pages.
+ */
+class BigAllocCache {
+public:
+    // Allocations bigger than this are never cached.
+    static constexpr size_t maxCachedSize = size_t(1) << 20;
+
+    // How many bytes a thread's cache holds, and the global one.
+    static constexpr size_t threadCapacity = size_t(4) << 20;
+    static constexpr size_t globalCapacity = size_t(32) << 20;
+
+    // How long, in milliseconds, an allocation stays cached unused.
+    static constexpr uint64_t maxAge = 1000;
+
+private:
+    // Bucket n holds n-page allocations.
+    static constexpr size_t numBuckets = maxCachedSize / pageSize + 1;
+
+    // Caches sweep out allocations past maxAge at most this often.
+    static constexpr uint64_t sweepInterval = maxAge / 4;
+
+    BigAlloc* m_newest[numBuckets] = {};
+    BigAlloc* m_oldest[numBuckets] = {};
+
+    size_t m_bytes = 0;
+    size_t m_capacity;
+
+    // Where evicted allocations go, or null to free them.
+    BigAllocCache* m_overflow;
+
+    // Held for every operation on a shared cache.
+    std::mutex m_lock;
+    bool m_shared;
+
+    uint64_t m_nextSweep = 0;
+
+    size_t m_hits = 0;
+    size_t m_misses = 0;
+
     /**
-     * A set of arenas with the following sizes:
-     * 0: 8 bytes
-     * 1: 16 bytes
-     * 2: 32 bytes
-     * ...
-     * 8: 1024 bytes
+     * Takes `obj` out of its bucket.
      */
-    Arena* m_arenas[9]; // Default initializer for pointer is nullptr
+    void unlink(BigAlloc* obj) {
+        size_t pages = obj->pages();
+
+        if (obj->m_cachePrev != nullptr)
+        {
+            obj->m_cachePrev->m_cacheNext = obj->m_cacheNext;
+        }
+        else
+        {
+            m_newest[pages] = obj->m_cacheNext;
+        }
+
+        if (obj->m_cacheNext != nullptr)
+        {
+            obj->m_cacheNext->m_cachePrev = obj->m_cachePrev;
+        }
+        else
+        {
+            m_oldest[pages] = obj->m_cachePrev;
+        }
+
+        m_bytes -= pages * pageSize;
+    }
 
-public:
     /**
-     * Allocates `bytes` bytes of data. If the data is too large to fit in an arena,
-     * it will be allocated using BigAlloc.
+     * Takes `obj` out of the cache and passes it on to the overflow cache, or
+     * frees it.
      */
-    void* alloc(size_t bytes) {
-        if (bytes <= 8)
+    void evict(BigAlloc* obj, uint64_t now) {
+        unlink(obj);
+
+        if (m_overflow == nullptr || !m_overflow->put(obj, now))
         {
-            Arena* arena = m_arenas[0];
-            Arena* temp;
-            if (arena == nullptr)
-            {
-                Arena* newArena = Arena::create(8);
-                temp = (Arena*)newArena->alloc();
-            }
-            else
-            {
-                temp = (Arena*)arena->alloc();
-            }
-            m_arenas[0] = arena;
-            return temp;
+            BigAlloc::release(obj);
         }
-        else if (bytes <= 16)
+    }
+
+    /**
+     * Evicts everything cached for maxAge or longer, if it's time to look.
+     */
+    void sweep(uint64_t now) {
+        if (now < m_nextSweep)
         {
-            Arena* arena = m_arenas[1];
-            Arena* temp;
-            if (arena == nullptr)
-            {
-                Arena* newArena = Arena::create(16);
-                m_arenas[1] = newArena;
-                temp = (Arena*)newArena->alloc();
-            }
-            else
-            {
-                temp = (Arena*)arena->alloc();
-            }
-            m_arenas[1] = arena;
-            return temp;
+            return;
         }
-        else if (bytes <= 32)
+        m_nextSweep = now + sweepInterval;
+
+        for (size_t pages = 1; pages < numBuckets; pages++)
         {
-            Arena* arena = m_arenas[2];
-            Arena* temp;
-            if (arena == nullptr)
-            {
-                Arena* newArena = Arena::create(32);
-                m_arenas[2] = newArena;
-                temp = (Arena*)newArena->alloc();
-            }
-            else
+            while (m_oldest[pages] != nullptr && now - m_oldest[pages]->m_cachedAt >= maxAge)
             {
-                temp = (Arena*)arena->alloc();
+                evict(m_oldest[pages], now);
             }
-            m_arenas[2] = arena;
-            return temp;
         }
-        else if (bytes <= 64)
+    }
+
+    /**
+     * Evicts the least recently cached allocation.
+     */
+    void evictOldest(uint64_t now) {
+        BigAlloc* oldest = nullptr;
+        for (size_t pages = 1; pages < numBuckets; pages++)
         {
-            Arena* arena = m_arenas[3];
-            Arena* temp;
-            if (arena == nullptr)
-            {
-                Arena* newArena = Arena::create(64);
-                m_arenas[3] = newArena;
-                temp = (Arena*)newArena->alloc();
-            }
-            else
+            BigAlloc* candidate = m_oldest[pages];
+            if (candidate != nullptr && (oldest == nullptr || candidate->m_cachedAt < oldest->m_cachedAt))
             {
-                temp = (Arena*)arena->alloc();
+                oldest = candidate;
             }
-            m_arenas[3] = arena;
-            return temp;
         }
-        else if (bytes <= 128)
+
+        evict(oldest, now);
+    }
+
+    /**
+     * Caches `obj`, which the user has already given up, evicting older
+     * allocations to make room. Returns false if it's too big to cache.
+     */
+    bool put(BigAlloc* obj, uint64_t now) {
+        size_t pages = obj->pages();
+        if (pages >= numBuckets || pages * pageSize > m_capacity)
         {
-            Arena* arena = m_arenas[4];
-            Arena* temp;
-            if (arena == nullptr)
-            {
-                Arena* newArena = Arena::create(128);
-                m_arenas[4] = newArena;
-                temp = (Arena*)newArena->alloc();
-            }
-            else
-            {
-                temp = (Arena*)arena->alloc();
-            }
-            m_arenas[4] = arena;
-            return temp;
+            return false;
         }
-        else if (bytes <= 256)
+
+        std::unique_lock<std::mutex> guard(m_lock, std::defer_lock);
+        if (m_shared)
         {
-            Arena* arena = m_arenas[5];
-            Arena* temp;
-            if (arena == nullptr)
-            {
-                Arena* newArena = Arena::create(256);
-                m_arenas[5] = newArena;
-                temp = (Arena*)newArena->alloc();
-            }
-            else
-            {
-                temp = (Arena*)arena->alloc();
-            }
-            m_arenas[5] = arena;
-            return temp;
+            guard.lock();
         }
-        else if (bytes <= 512)
+
+        sweep(now);
+
+        obj->m_cachedAt = now;
+        obj->m_cachePrev = nullptr;
+        obj->m_cacheNext = m_newest[pages];
+        if (m_newest[pages] != nullptr)
         {
-            Arena* arena = m_arenas[6];
-            Arena* temp;
-            if (arena == nullptr)
-            {
-                Arena* newArena = Arena::create(512);
-                m_arenas[6] = newArena;
-                temp = (Arena*)newArena->alloc();
-            }
-            else
-            {
-                temp = (Arena*)arena->alloc();
-            }
-            m_arenas[6] = arena;
-            return temp;
+            m_newest[pages]->m_cachePrev = obj;
+        }
+        else
+        {
+            m_oldest[pages] = obj;
         }
-        else if (bytes <= 1024)
+        m_newest[pages] = obj;
+        m_bytes += pages * pageSize;
+
+        while (m_bytes > m_capacity)
         {
-            Arena* arena = m_arenas[7];
-            Arena* temp;
-            if (arena == nullptr)
+            evictOldest(now);
+        }
+        return true;
+    }
+
+    /**
+     * Takes an allocation of `pages` pages out of the cache, falling back to the
+     * overflow cache. Returns null if neither has one.
+     */
+    BigAlloc* take(size_t pages, uint64_t now) {
+        BigAlloc* obj;
+
+        {
+            std::unique_lock<std::mutex> guard(m_lock, std::defer_lock);
+            if (m_shared)
             {
-                Arena* newArena = Arena::create(1024);
-                m_arenas[7] = newArena;
-                temp = (Arena*)newArena->alloc();
+                guard.lock();
             }
-            else
+
+            sweep(now);
+
+            obj = m_newest[pages];
+            if (obj != nullptr)
             {
-                temp = (Arena*)arena->alloc();
+                unlink(obj);
+                m_hits++;
+                return obj;
             }
-            m_arenas[7] = arena;
-            return temp;
-        }
-        else
-        {
-            return BigAlloc::alloc(bytes);
+            m_misses++;
         }
+
+        return m_overflow != nullptr ? m_overflow->take(pages, now) : nullptr;
     }
 
+public:
+    BigAllocCache(const BigAllocCache& other) = delete;
+
     /**
-     * Determines the allocation type for the given pointer and calls
-     * the appropriate free method.
+     * Creates a cache holding up to `capacity` bytes, evicting to `overflow` if
+     * it isn't null. A `shared` cache can be used from any thread.
      */
-    void free(void* ptr) {
-        uintptr_t n = reinterpret_cast<uintptr_t>(ptr); 
-        uintptr_t remainder = n % pageSize;
-        n = n - remainder;
-        MMapObject* map = reinterpret_cast<MMapObject*>(n);
-        if (map->arenaSize() == 0)
+    BigAllocCache(size_t capacity, BigAllocCache* overflow, bool shared)
+        : m_capacity(capacity), m_overflow(overflow), m_shared(shared)
+    {
+    }
+
+    ~BigAllocCache() {
+        flush(now());
+    }
+
+    /**
+     * The cache all threads' caches overflow into. It's never destroyed, so
+     * threads that outlive static destructors can still flush into it.
+     */
+    static BigAllocCache& global() {
+        alignas(BigAllocCache) static char storage[sizeof(BigAllocCache)];
+        static BigAllocCache* cache = new (storage) BigAllocCache(globalCapacity, nullptr, true);
+        return *cache;
+    }
+
+    /**
+     * Takes the global() cache's lock ahead of fork(), so the child doesn't
+     * inherit it mid-update. unlockAfterFork() releases it in both parent and
+     * child.
+     */
+    static void lockForFork() {
+        global().m_lock.lock();
+    }
+
+    static void unlockAfterFork() {
+        global().m_lock.unlock();
+    }
+
+    /**
+     * The current time in milliseconds, from a clock cheap enough to read on
+     * every big allocation.
+     */
+    static uint64_t now() {
+        timespec time;
+        clock_gettime(CLOCK_MONOTONIC_COARSE, &time);
+        return uint64_t(time.tv_sec) * 1000 + time.tv_nsec / 1'000'000;
+    }
+
+    /**
+     * Returns a cached allocation with room for `size` bytes, or null if there
+     * isn't one. `now` is the time from now().
+     */
+    void* alloc(size_t size, uint64_t now) {
+        if (size > maxCachedSize)
         {
-            MMapObject::dealloc(ptr);
+            return nullptr;
         }
-        else
+
+        size_t pages = BigAlloc::pagesFor(size);
+        if (pages >= numBuckets)
         {
-            Arena* arena = (Arena*) map;
-            bool freed = arena->free();
-            MMapObject::dealloc(ptr);
+            return nullptr;
         }
-    }
+
+        BigAlloc* obj = take(pages, now);
+        if (obj == nullptr)
+        {
+            return nullptr;
+        }
+
+        obj->init(size, 0);
+        BigAlloc::s_outstandingPages++;
+        return obj->m_data;
+    }
+
+    /**
+     * Frees `obj` into the cache, or for the real if it's too big to cache.
+     */
+    void free(BigAlloc* obj, uint64_t now) {
+        if (!put(obj, now))
+        {
+            BigAlloc::release(obj);
+        }
+        BigAlloc::releasedPages();
+    }
+
+    /**
+     * Evicts everything in the cache.
+     */
+    void flush(uint64_t now) {
+        std::unique_lock<std::mutex> guard(m_lock, std::defer_lock);
+        if (m_shared)
+        {
+            guard.lock();
+        }
+
+        for (size_t pages = 1; pages < numBuckets; pages++)
+        {
+            while (m_oldest[pages] != nullptr)
+            {
+                evict(m_oldest[pages], now);
+            }
+        }
+    }
+
+    /**
+     * The number of bytes of allocations in the cache.
+     */
+    size_t bytes() {
+        return m_bytes;
+    }
+
+    /**
+     * How many allocations this cache has served, and how many it couldn't.
+     * Misses served by the overflow cache count as hits there.
+     */
+    size_t hits() {
+        return m_hits;
+    }
+
+    size_t misses() {
+        return m_misses;
+    }
+};
+
+/**
+ * How an arena keeps track of which of its slots are free.
+ *
+ * FreeList: freed slots form an intrusive LIFO list and never-touched slots are
+ * handed out by a bump pointer. Reuse is most-recently-freed first, which keeps
+ * churn in cache.
+ *
+ * Bitmap: one bit per slot, set when the slot is free. Reuse is lowest-address
+ * first, which keeps long-lived arenas dense.
+ */
+enum class SlotMode : uint8_t {
+    FreeList,
+    Bitmap
+};
+
+/**
+ * The most slots any arena has: a page of the smallest items.
+ */
+constexpr size_t maxArenaSlots = pageSize / 8;
+
+/**
+ * The size of a cache line. Arena state written by different threads is kept on
+ * separate lines so they don't contend for them.
+ */
+constexpr size_t cacheLineSize = 64;
+
+class Arena;
+class ArenaList;
+
+/**
+ * A lock-free stack of arenas an ArenaStore has parked as full and that have
+ * since had items freed into them. Freeing threads push; the owning store takes
+ * the whole stack at once when it needs more slots, so it never has to scan its
+ * full arenas for ones that have room again.
+ */
+class ArenaStack {
+    std::atomic<Arena*> m_head { nullptr };
+
+public:
+    /**
+     * Pushes `arena`. May be called from any thread.
+     */
+    void push(Arena* arena);
+
+    /**
+     * Empties the stack and returns what was on it, linked through
+     * Arena::stackNext().
+     */
+    Arena* takeAll();
+};
+
+// This is the metadata for your Arena allocator. It inherits from MMapObject, and
+// thus has a size_. Unlike a BigAlloc, it doesn't live in the memory it describes:
+// descriptors come from a MetadataSlab and the span of slots comes from ArenaHeap,
+// so the whole span holds items.
+//
+// An arena is allocated from by a single owner (an ArenaStore), while its items
+// may be freed by any thread. The owner's state is plain, unsynchronized fields
+// that only it touches, so allocating and freeing on the owning thread takes no
+// locked instructions. Frees from other threads go to separate atomic fields on
+// their own cache lines, which the owner collects once its own free slots run out.
+class alignas(cacheLineSize) Arena : public MMapObject {
+    // This inherits from MMapObject, so it also has the mmapSize and arenaSize
+    // members as well. mmapSize is the size of the span.
+
+    friend class ArenaList;
+    friend class ArenaStack;
+    friend class SizeClassRegions;
+
+    // A freed slot. Free slots are threaded into an intrusive LIFO list through
+    // their first word, so the list costs no memory beyond the slots themselves.
+    // The smallest item size is 8 bytes, which is exactly enough room for the link.
+    struct FreeSlot {
+        FreeSlot* next;
+    };
+
+    // Set in m_remoteState once the owner has retired the arena. A retired arena
+    // never allocates again; whoever frees its last live item releases the pages.
+    static constexpr size_t retiredBit = size_t(1) << (sizeof(size_t) * 8 - 1);
+
+    // Values of m_parkState. The owner parks an arena when it has no slots left,
+    // and the first free into a parked arena, from any thread, queues it on the
+    // owner's ArenaStack.
+    static constexpr uint32_t notParked = 0;
+    static constexpr uint32_t parked = 1;
+    static constexpr uint32_t queued = 2;
+
+    // Read by every thread, written only when the arena is created or retired.
+
+    // The first slot, at the start of the span.
+    char* m_slots;
+
+    // The stack of the ArenaStore allocating from this arena, or null once it's
+    // retired. Identifies the owner.
+    std::atomic<ArenaStack*> m_owner;
+
+    // The number of slots that fit in the span.
+    uint32_t m_capacity;
+
+    SlotMode m_mode;
+
+    // Whether the span was zero when the arena was created, so never-touched
+    // slots still are. SizeClassRegions keeps this across a span's reuse.
+    bool m_zeroed;
+
+    // Owner only.
+
+    // Slots freed by the owner, or collected from m_remoteFree. Unused in
+    // SlotMode::Bitmap.
+    alignas(cacheLineSize) FreeSlot* m_localFree;
+
+    // A pointer to the next never-touched slot in the arena. Slots before this
+    // address have been handed out at least once and are recycled via m_localFree.
+    // In SlotMode::Bitmap, slots are handed out from the bitmap, and this only
+    // marks the end of the highest slot handed out so far.
+    char* m_next;
+
+    // The number of slots handed out, less those freed by the owner and those
+    // freed by other threads that the owner has collected.
+    size_t m_used;
+
+    // Set by the owner to order its arenas by age.
+    size_t m_serial;
+
+    // The owner's list this arena is on, and its neighbours there.
+    ArenaList* m_list;
+    Arena* m_listPrev;
+    Arena* m_listNext;
+
+    // Whether the owner has retired the arena.
+    bool m_retired;
+
+    // In SlotMode::Bitmap, one bit per slot, set while the slot is free as far as
+    // the owner knows.
+    alignas(cacheLineSize) uint64_t m_bitmap[maxArenaSlots / 64];
+
+    // Written by other threads.
+
+    // Slots freed by threads other than the owner. Unused in SlotMode::Bitmap.
+    alignas(cacheLineSize) std::atomic<FreeSlot*> m_remoteFree;
+
+    // Minus the number of slots freed by other threads since the owner last
+    // collected them, so m_used + m_remoteState is the number of live slots.
+    // Retiring adds m_used and retiredBit, after which it is retiredBit + the live
+    // slots.
+    std::atomic<size_t> m_remoteState;
+
+    // One of notParked, parked or queued.
+    std::atomic<uint32_t> m_parkState;
+
+    // The next arena on the owner's ArenaStack while queued.
+    Arena* m_stackNext;
+
+    // In SlotMode::Bitmap, the slots freed by other threads since the owner last
+    // collected them.
+    alignas(cacheLineSize) std::atomic<uint64_t> m_remoteBitmap[maxArenaSlots / 64];
+
+    /**
+     * The number of 64-bit words in the occupancy bitmap.
+     */
+    size_t bitmapWords() {
+        return (m_capacity + 63) / 64;
+    }
+
+    /**
+     * Whether the bump pointer has run past the last slot that fits in the span.
+     */
+    bool bumpExhausted() {
+        return m_next + arenaSize() > m_slots + m_capacity * arenaSize();
+    }
+
+    /**
+     * Whether other threads have freed slots the owner hasn't collected yet.
+     */
+    bool remoteFreesPending() {
+        if (m_mode == SlotMode::Bitmap)
+        {
+            for (size_t i = 0; i < bitmapWords(); i++)
+            {
+                if (m_remoteBitmap[i].load() != 0)
+                {
+                    return true;
+                }
+            }
+            return false;
+        }
+        return m_remoteFree.load() != nullptr;
+    }
+
+    /**
+     * Moves the slots freed by other threads over to the owner's side, and takes
+     * their count off m_used.
+     */
+    void collectRemoteFrees() {
+        if (m_mode == SlotMode::Bitmap)
+        {
+            for (size_t i = 0; i < bitmapWords(); i++)
+            {
+                if (m_remoteBitmap[i].load(std::memory_order_relaxed) != 0)
+                {
+                    m_bitmap[i] |= m_remoteBitmap[i].exchange(0, std::memory_order_acquire);
+                }
+            }
+        }
+        else if (m_remoteFree.load(std::memory_order_relaxed) != nullptr)
+        {
+            FreeSlot* collected = m_remoteFree.exchange(nullptr, std::memory_order_acquire);
+            FreeSlot* last = collected;
+            while (last->next != nullptr)
+            {
+                last = last->next;
+            }
+            last->next = m_localFree;
+            m_localFree = collected;
+        }
+
+        // Each remote free decrements this after publishing its slot, so we may
+        // fold in fewer frees than we just collected, but never more.
+        m_used += m_remoteState.exchange(0, std::memory_order_acq_rel);
+    }
+
+    /**
+     * Takes a slot in SlotMode::FreeList, or returns null if there are none.
+     */
+    void* allocFromFreeList() {
+        if (m_localFree == nullptr)
+        {
+            if (!bumpExhausted())
+            {
+                char* slot = m_next;
+                m_next += arenaSize();
+                return slot;
+            }
+
+            // Out of slots of our own, so take everything other threads freed.
+            collectRemoteFrees();
+            if (m_localFree == nullptr)
+            {
+                return nullptr;
+            }
+        }
+
+        FreeSlot* slot = m_localFree;
+        m_localFree = slot->next;
+        return slot;
+    }
+
+    /**
+     * Takes the lowest free slot in SlotMode::Bitmap, or returns null if there
+     * are none.
+     */
+    void* allocFromBitmap() {
+        size_t words = bitmapWords();
+        size_t word = findNonZeroWord(m_bitmap, words);
+
+        if (word == words)
+        {
+            // Out of slots of our own, so take everything other threads freed.
+            collectRemoteFrees();
+
+            word = findNonZeroWord(m_bitmap, words);
+            if (word == words)
+            {
+                return nullptr;
+            }
+        }
+
+        size_t bit = __builtin_ctzll(m_bitmap[word]);
+        m_bitmap[word] &= m_bitmap[word] - 1;
+
+        char* slot = m_slots + (word * 64 + bit) * arenaSize();
+        if (slot >= m_next)
+        {
+            m_next = slot + arenaSize();
+        }
+        return slot;
+    }
+
+    /**
+     * The index of the slot holding `ptr`.
+     */
+    size_t slotIndex(void* ptr) {
+        return (static_cast<char*>(ptr) - m_slots) / arenaSize();
+    }
+
+public:
+    /**
+     * Creates an arena with items of the given size spanning `spanSize` bytes,
+     * which must be a multiple of pageSize no larger than maxSpanPages pages,
+     * to be allocated from by the store owning `owner`. The descriptor comes from
+     * a MetadataSlab and the span from ArenaHeap. Returns null if either is
+     * exhausted.
+     */
+    static Arena* create(uint32_t itemSize, size_t spanSize = pageSize, SlotMode mode = SlotMode::FreeList,
+                         ArenaStack* owner = nullptr) {
+        Arena* obj = MetadataSlab<Arena>::alloc();
+        if (obj == nullptr)
+        {
+            return nullptr;
+        }
+
+        bool zeroed;
+        char* span = ArenaHeap::allocSpan(spanSize / pageSize, obj, 1, &zeroed);
+        if (span == nullptr)
+        {
+            MetadataSlab<Arena>::free(obj);
+            return nullptr;
+        }
+
+        return place(obj, span, itemSize, spanSize, mode, owner, zeroed);
+    }
+
+    /**
+     * Sets up the descriptor `obj` for an arena over the fresh span `span`, for
+     * arenas whose descriptor and span come from somewhere other than a
+     * MetadataSlab and ArenaHeap, such as SizeClassRegions. `zeroed` says whether
+     * the span is known to be zero. Returns `obj`.
+     */
+    static Arena* place(Arena* obj, char* span, uint32_t itemSize, size_t spanSize, SlotMode mode,
+                        ArenaStack* owner, bool zeroed) {
+        obj->init(spanSize, itemSize);
+        obj->m_slots = span;
+        obj->m_owner = owner;
+        obj->m_capacity = spanSize / itemSize;
+        obj->m_mode = mode;
+        obj->m_zeroed = zeroed;
+        obj->m_localFree = nullptr;
+        obj->m_next = span;
+        obj->m_used = 0;
+        obj->m_serial = 0;
+        obj->m_list = nullptr;
+        obj->m_listPrev = nullptr;
+        obj->m_listNext = nullptr;
+        obj->m_retired = false;
+        obj->m_remoteFree = nullptr;
+        obj->m_remoteState = 0;
+        obj->m_parkState = notParked;
+        obj->m_stackNext = nullptr;
+
+        if (mode == SlotMode::Bitmap)
+        {
+            for (size_t i = 0; i < obj->bitmapWords(); i++)
+            {
+                size_t slotsInWord = std::min<size_t>(obj->m_capacity - i * 64, 64);
+                obj->m_bitmap[i] = slotsInWord == 64 ? ~uint64_t(0) : (uint64_t(1) << slotsInWord) - 1;
+                new (&obj->m_remoteBitmap[i]) std::atomic<uint64_t>(0);
+            }
+        }
+
+        s_outstandingPages++;
+        return obj;
+    }
+
+    /**
+     * Gives the arena's span back to where it came from, which returns its memory
+     * to the OS, and recycles the descriptor.
+     */
+    static void destroy(Arena* arena);
+
+    /**
+     * Allocates an item in the arena and returns its address. Freed slots are
+     * reused according to the arena's SlotMode, and slots freed by other threads
+     * are collected once the owner's own run out. Returns null if the arena is
+     * full or has been retired. Only the owner may call this.
+     */
+    void* alloc() {
+        if (m_retired)
+        {
+            return nullptr;
+        }
+
+        void* slot = m_mode == SlotMode::Bitmap ? allocFromBitmap() : allocFromFreeList();
+        if (slot != nullptr)
+        {
+            m_used++;
+        }
+        return slot;
+    }
+
+    /**
+     * Returns the item at `ptr` to the arena on behalf of the owner, which must
+     * not have retired it.
+     */
+    void freeLocal(void* ptr) {
+        if (m_mode == SlotMode::Bitmap)
+        {
+            size_t index = slotIndex(ptr);
+            m_bitmap[index / 64] |= uint64_t(1) << (index % 64);
+        }
+        else
+        {
+            FreeSlot* slot = reinterpret_cast<FreeSlot*>(ptr);
+            slot->next = m_localFree;
+            m_localFree = slot;
+        }
+
+        m_used--;
+    }
+
+    /**
+     * alloc()'s common case for the owner: a slot in SlotMode::FreeList taken
+     * from its own free slots, or bumped, when that can't leave the arena full.
+     * Returns null otherwise, having done nothing, so the caller needn't check
+     * whether to park the arena.
+     */
+    void* allocFast() {
+        if (m_mode != SlotMode::FreeList)
+        {
+            return nullptr;
+        }
+
+        FreeSlot* slot = m_localFree;
+        if (slot != nullptr)
+        {
+            if (slot->next == nullptr && bumpExhausted())
+            {
+                return nullptr;
+            }
+            m_localFree = slot->next;
+            m_used++;
+            return slot;
+        }
+
+        char* bumped = m_next;
+        if (bumped + 2 * arenaSize() > m_slots + m_capacity * arenaSize())
+        {
+            return nullptr;
+        }
+        m_next = bumped + arenaSize();
+        m_used++;
+        return bumped;
+    }
+
+    /**
+     * Returns the item at `ptr` to the arena on behalf of the owner, as
+     * freeLocal() does, if the arena stays where it is in the owner's lists:
+     * it isn't parked, and it either keeps something live or is at the front of
+     * its partial list, which keeps it even when empty. Returns false, having
+     * done nothing, otherwise.
+     */
+    bool freeLocalFast(void* ptr) {
+        if (isParked() || (m_used == 1 && m_listPrev != nullptr))
+        {
+            return false;
+        }
+        freeLocal(ptr);
+        return true;
+    }
+
+    /**
+     * Returns the item at `ptr` to the arena. May be called from any thread.
+     * Returns true if this arena has been retired and everything is free'd, in
+     * which case the caller is responsible for destroying it.
+     *
+     * If the owner has parked the arena, the first such free queues it on the
+     * owner's ArenaStack.
+     */
+    bool free(void* ptr) {
+        if (m_mode == SlotMode::Bitmap)
+        {
+            size_t index = slotIndex(ptr);
+            m_remoteBitmap[index / 64].fetch_or(uint64_t(1) << (index % 64));
+        }
+        else
+        {
+            FreeSlot* slot = reinterpret_cast<FreeSlot*>(ptr);
+            slot->next = m_remoteFree.load(std::memory_order_relaxed);
+
+            while (!m_remoteFree.compare_exchange_weak(slot->next, slot)) { }
+        }
+
+        // Our slot is published before we look, and park() publishes the state
+        // before it looks for slots, so one of us sees the other. Our item is
+        // still counted as live until the decrement below, so the arena and its
+        // owner's stack can't go away before then.
+        uint32_t state = parked;
+        if (m_parkState.load() == parked && m_parkState.compare_exchange_strong(state, queued))
+        {
+            m_owner.load(std::memory_order_relaxed)->push(this);
+        }
+
+        return m_remoteState.fetch_sub(1, std::memory_order_acq_rel) == (retiredBit | 1);
+    }
+
+    /**
+     * Marks a full arena as parked, so that the next free into it queues it on
+     * the owner's ArenaStack. Returns false if slots were freed in the meantime,
+     * in which case the arena isn't parked and can keep allocating. Only the
+     * owner may call this.
+     */
+    bool park() {
+        m_parkState.store(parked);
+        if (!remoteFreesPending())
+        {
+            return true;
+        }
+
+        // Someone freed into it first. If they've also seen it parked, it's on
+        // its way onto the stack and stays parked until the owner takes it off.
+        uint32_t state = parked;
+        return !m_parkState.compare_exchange_strong(state, notParked);
+    }
+
+    /**
+     * Unparks a parked arena that the owner has freed into. Returns false if
+     * another thread has already queued it on the owner's ArenaStack, in which
+     * case it stays parked until the owner takes it off.
+     */
+    bool unpark() {
+        uint32_t state = parked;
+        return m_parkState.compare_exchange_strong(state, notParked);
+    }
+
+    /**
+     * Unparks an arena the owner took off its ArenaStack, and collects the slots
+     * freed into it.
+     */
+    void unqueue() {
+        m_parkState.store(notParked, std::memory_order_relaxed);
+        collectRemoteFrees();
+    }
+
+    /**
+     * Whether the owner has parked this arena, whether or not it's been queued
+     * since. Only meaningful to the owner.
+     */
+    bool isParked() {
+        return m_parkState.load(std::memory_order_relaxed) != notParked;
+    }
+
+    /**
+     * Retires the arena so it won't hand out any more items. Returns true if
+     * nothing in it is live, in which case the caller should destroy it.
+     * Otherwise the last call to free() will report that it is empty. Only the
+     * owner may call this, and not while the arena is queued.
+     */
+    bool retire() {
+        m_retired = true;
+        m_owner.store(nullptr, std::memory_order_relaxed);
+
+        size_t handoff = retiredBit + m_used;
+        return m_remoteState.fetch_add(handoff, std::memory_order_acq_rel) + handoff == retiredBit;
+    }
+
+    /**
+     * Whether or not this arena has no slots left for the owner, counting those
+     * freed by other threads. Only meaningful to the owner.
+     */
+    bool full() {
+        if (m_retired)
+        {
+            return true;
+        }
+        if (m_mode == SlotMode::Bitmap)
+        {
+            return findNonZeroWord(m_bitmap, bitmapWords()) == bitmapWords()
+                && findNonZeroWord(m_remoteBitmap, bitmapWords()) == bitmapWords();
+        }
+        return m_localFree == nullptr && bumpExhausted() && m_remoteFree.load(std::memory_order_relaxed) == nullptr;
+    }
+
+    /**
+     * Whether the owner knows of no live items in this arena. Items freed by other
+     * threads only count once they've been collected, so this may be false for an
+     * arena that is in fact empty, but never the other way around. Only
+     * meaningful to the owner.
+     */
+    bool empty() {
+        return m_used == 0;
+    }
+
+    /**
+     * The ArenaStack of the store allocating from this arena, or null if it's
+     * been retired.
+     */
+    const ArenaStack* owner() {
+        return m_owner.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * The number the owner gave this arena to order it by age.
+     */
+    size_t serial() {
+        return m_serial;
+    }
+
+    void setSerial(size_t serial) {
+        m_serial = serial;
+    }
+
+    /**
+     * The owner's list this arena is on, if any.
+     */
+    ArenaList* list() {
+        return m_list;
+    }
+
+    /**
+     * The arena after this one on its list.
+     */
+    Arena* listNext() {
+        return m_listNext;
+    }
+
+    /**
+     * The arena after this one on an ArenaStack.
+     */
+    Arena* stackNext() {
+        return m_stackNext;
+    }
+
+    /**
+     * The total number of slots in this arena.
+     */
+    size_t capacity() {
+        return m_capacity;
+    }
+
+    /**
+     * The number of slots available to alloc(), including those freed by other
+     * threads and not yet collected. In SlotMode::Bitmap this is a popcount of the
+     * bitmaps. Only meaningful to the owner, before the arena is retired.
+     */
+    size_t freeSlots() {
+        if (m_mode == SlotMode::Bitmap)
+        {
+            return countSetBits(m_bitmap, bitmapWords()) + countSetBits(m_remoteBitmap, bitmapWords());
+        }
+        return m_capacity - (m_used + m_remoteState.load(std::memory_order_relaxed));
+    }
+
+    SlotMode slotMode() {
+        return m_mode;
+    }
+
+    /**
+     * Returns a pointer to the first slot in the arena.
+     */
+    char* slots() {
+        return m_slots;
+    }
+
+    /**
+     * Whether `ptr` points into one of the arena's slots.
+     */
+    bool contains(const void* ptr) {
+        const char* byte = static_cast<const char*>(ptr);
+        return byte >= m_slots && byte < m_slots + size_t(m_capacity) * arenaSize();
+    }
+
+    /**
+     * Returns a pointer to the next never-touched item in the arena.
+     */
+    char* next() {
+        return m_next;
+    }
+
+    /**
+     * Whether never-touched items, those at or past next(), read as zero.
+     */
+    bool zeroed() {
+        return m_zeroed;
+    }
+};
+
+inline void ArenaStack::push(Arena* arena) {
+    arena->m_stackNext = m_head.load(std::memory_order_relaxed);
+    while (!m_head.compare_exchange_weak(arena->m_stackNext, arena, std::memory_order_release)) { }
+}
+
+inline Arena* ArenaStack::takeAll() {
+    if (m_head.load(std::memory_order_relaxed) == nullptr)
+    {
+        return nullptr;
+    }
+    return m_head.exchange(nullptr, std::memory_order_acquire);
+}
+
+/**
+ * An intrusive doubly linked list of arenas, threaded through the arenas' owner
+ * fields. An arena is on at most one list at a time, and only its owner touches
+ * the list.
+ */
+class ArenaList {
+    Arena* m_head = nullptr;
+    Arena* m_tail = nullptr;
+    size_t m_size = 0;
+
+public:
+    Arena* front() {
+        return m_head;
+    }
+
+    size_t size() {
+        return m_size;
+    }
+
+    bool empty() {
+        return m_head == nullptr;
+    }
+
+    void pushFront(Arena* arena) {
+        arena->m_list = this;
+        arena->m_listPrev = nullptr;
+        arena->m_listNext = m_head;
+
+        if (m_head != nullptr)
+        {
+            m_head->m_listPrev = arena;
+        }
+        else
+        {
+            m_tail = arena;
+        }
+        m_head = arena;
+        m_size++;
+    }
+
+    void pushBack(Arena* arena) {
+        arena->m_list = this;
+        arena->m_listPrev = m_tail;
+        arena->m_listNext = nullptr;
+
+        if (m_tail != nullptr)
+        {
+            m_tail->m_listNext = arena;
+        }
+        else
+        {
+            m_head = arena;
+        }
+        m_tail = arena;
+        m_size++;
+    }
+
+    void remove(Arena* arena) {
+        if (arena->m_listPrev != nullptr)
+        {
+            arena->m_listPrev->m_listNext = arena->m_listNext;
+        }
+        else
+        {
+            m_head = arena->m_listNext;
+        }
+
+        if (arena->m_listNext != nullptr)
+        {
+            arena->m_listNext->m_listPrev = arena->m_listPrev;
+        }
+        else
+        {
+            m_tail = arena->m_listPrev;
+        }
+
+        arena->m_list = nullptr;
+        m_size--;
+    }
+};
+
+/**
+ * A size class served by arenas.
+ */
+struct SizeClass {
+    // The size of each item, in bytes.
+    uint32_t size;
+
+    // The number of items that fit in one arena.
+    uint32_t slots;
+
+    // The number of bytes mapped for each arena.
+    uint32_t spanSize;
+};
+
+/**
+ * The item sizes served by arenas. Above 32 bytes there are four classes per
+ * power of two, which bounds internal fragmentation at 25% instead of the 50%
+ * we'd get from powers of two alone. Every size is a multiple of 16 above 8
+ * bytes so items stay 16-byte aligned.
+ */
+constexpr uint32_t sizeClassSizes[] = {
+    8, 16, 32, 48, 64, 80, 96, 112, 128, 160, 192, 224,
+    256, 320, 384, 448, 512, 640, 768, 896, 1024,
+    1280, 1536, 1792, 2048, 2560, 3072, 3584, 4096,
+    5120, 6144, 7168, 8192, 10240, 12288, 14336, 16384,
+    20480, 24576, 28672, 32768
+};
+
+/**
+ * The number of size classes served by arenas.
+ */
+constexpr size_t numSizeClasses = sizeof(sizeClassSizes) / sizeof(sizeClassSizes[0]);
+
+/**
+ * An arena wastes the end of its span that its slots don't fill. Spans
+ * grow a page at a time until that is at most 1 / maxSpanWaste of the span.
+ */
+constexpr uint32_t maxSpanWaste = 16;
+
+/**
+ * Picks the smallest span, in whole pages up to maxSpanPages, whose waste is
+ * within 1 / maxSpanWaste for items of `size` bytes. If none is, picks the span
+ * with the least waste.
+ */
+constexpr SizeClass makeSizeClass(uint32_t size) {
+    SizeClass best {};
+
+    for (uint32_t pages = 1; pages <= maxSpanPages; pages++)
+    {
+        uint32_t spanSize = pages * pageSize;
+        uint32_t slots = spanSize / size;
+        if (slots == 0)
+        {
+            continue;
+        }
+
+        uint64_t waste = spanSize - slots * size;
+        uint64_t bestWaste = best.spanSize - best.slots * best.size;
+        if (best.slots == 0 || waste * best.spanSize < bestWaste * spanSize)
+        {
+            best = { size, slots, spanSize };
+        }
+        if (waste * maxSpanWaste <= spanSize)
+        {
+            break;
+        }
+    }
+
+    return best;
+}
+
+constexpr std::array<SizeClass, numSizeClasses> makeSizeClasses() {
+    std::array<SizeClass, numSizeClasses> classes {};
+
+    for (size_t i = 0; i < numSizeClasses; i++)
+    {
+        classes[i] = makeSizeClass(sizeClassSizes[i]);
+    }
+
+    return classes;
+}
+
+/**
+ * The size class table, indexed by sizeClassIndex().
+ */
+constexpr std::array<SizeClass, numSizeClasses> sizeClasses = makeSizeClasses();
+
+constexpr bool slotsFitBitmap() {
+    for (const SizeClass& sizeClass : sizeClasses)
+    {
+        if (sizeClass.slots > maxArenaSlots)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+static_assert(slotsFitBitmap(), "An arena's slots must fit in its bitmap");
+
+/**
+ * The largest request served by an arena. Anything bigger goes to BigAlloc.
+ */
+constexpr size_t maxArenaItemSize = sizeClasses[numSizeClasses - 1].size;
+
+/**
+ * Requests up to this size are looked up in sizeClassLookup. Above it, classes
+ * are spaced four per power of two, which sizeClassIndex() computes with clz.
+ */
+constexpr size_t maxLookupSize = 1024;
+
+// Every class size is a multiple of 8, so requests are looked up in 8-byte steps.
+constexpr size_t sizeClassLookupShift = 3;
+
+constexpr std::array<uint8_t, (maxLookupSize >> sizeClassLookupShift) + 1> makeSizeClassLookup() {
+    std::array<uint8_t, (maxLookupSize >> sizeClassLookupShift) + 1> lookup {};
+    size_t index = 0;
+
+    for (size_t step = 0; step < lookup.size(); step++)
+    {
+        while (sizeClasses[index].size < (step << sizeClassLookupShift))
+        {
+            index++;
+        }
+        lookup[step] = uint8_t(index);
+    }
+
+    return lookup;
+}
+
+/**
+ * Maps a request, rounded up to a multiple of 8 bytes, to its size class.
+ */
+constexpr auto sizeClassLookup = makeSizeClassLookup();
+
+// The index of the first class above maxLookupSize, i.e. the first class in
+// (1024, 2048].
+constexpr size_t firstLogLinearClass = sizeClassLookup[maxLookupSize >> sizeClassLookupShift] + 1;
+
+/**
+ * Maps a request of `bytes` bytes (at most maxArenaItemSize) to the smallest size
+ * class that fits it. Small requests take a single load from a 129-byte table,
+ * which fits in three cache lines. Larger ones fall in (2^(k-1), 2^k] for
+ * k = bit width of bytes - 1, which holds four classes spaced 2^(k-3) apart; the
+ * two bits below the leading one pick between them. Zero-byte requests get the
+ * smallest class.
+ */
+inline size_t sizeClassIndex(size_t bytes) {
+    if (bytes <= maxLookupSize)
+    {
+        return sizeClassLookup[(bytes + 7) >> sizeClassLookupShift];
+    }
+
+    size_t rounded = bytes - 1;
+    size_t width = 64 - __builtin_clzll(rounded);
+    size_t quarter = (rounded >> (width - 3)) & 3;
+    return firstLogLinearClass + (width - 11) * 4 + quarter;
+}
+
+/**
+ * Maps a request of `bytes` bytes aligned to `alignment`, a power of two no
+ * bigger than pageSize, to the smallest size class whose items are all aligned
+ * to it, i.e. whose size is a multiple of it, since spans are page aligned.
+ * Returns numSizeClasses if no class fits, as when either is bigger than the
+ * biggest class.
+ */
+inline size_t alignedSizeClassIndex(size_t bytes, size_t alignment) {
+    if (bytes > maxArenaItemSize || alignment > maxArenaItemSize)
+    {
+        return numSizeClasses;
+    }
+
+    size_t index = sizeClassIndex(std::max(bytes, alignment));
+    while (index < numSizeClasses && sizeClasses[index].size % alignment != 0)
+    {
+        index++;
+    }
+    return index;
+}
+
+/**
+ * The alignment every item myMalloc() hands out has: that of the smallest size
+ * class, since every class is a multiple of it and spans are page aligned.
+ * Callers wanting more go through myAlignedAlloc().
+ */
+constexpr size_t minItemAlignment = sizeClasses[0].size;
+
+/**
+ * How many empty arenas an ArenaStore keeps per size class, so that churn around
+ * an arena boundary doesn't map and unmap a span every time. Arenas that empty
+ * out beyond this are given back to the OS.
+ */
+constexpr size_t maxEmptyArenas = 1;
+
+/**
+ * For each class, ceil(2^32 / pages per span). Multiplying a page index in a
+ * SizeClassRegions region by this and shifting right by 32 divides it by the
+ * pages per span, exactly for the 2^20 pages a region holds.
+ */
+constexpr std::array<uint64_t, numSizeClasses> makeSpanReciprocals() {
+    std::array<uint64_t, numSizeClasses> reciprocals {};
+
+    for (size_t i = 0; i < numSizeClasses; i++)
+    {
+        uint64_t pages = sizeClasses[i].spanSize / pageSize;
+        reciprocals[i] = ((uint64_t(1) << 32) + pages - 1) / pages;
+    }
+
+    return reciprocals;
+}
+
+/**
+ * An optional layout for arenas in which each size class owns a dedicated,
+ * regionSize range of address space, reserved up front next to the others. An
+ * item's size class is then the bits of its address above the region size, its
+ * span is its offset in the region divided by the class's span size, and its
+ * arena's descriptor sits at that index in the class's descriptor array. So
+ * free() finds an item's arena with arithmetic alone, rather than by loading it
+ * from the PageMap.
+ *
+ * Spans are made accessible a chunk at a time, like ArenaHeap's. Released spans
+ * give their memory back with MADV_DONTNEED and are recycled LIFO within their
+ * class. Descriptors are never freed, but take memory only once used.
+ */
+class SizeClassRegions {
+public:
+    static constexpr size_t regionShift = 32;
+    static constexpr size_t regionSize = size_t(1) << regionShift;
+
+private:
+    static constexpr size_t reservedSize = numSizeClasses * regionSize;
+
+    static constexpr size_t pageShift = __builtin_ctzll(pageSize);
+
+    static constexpr size_t commitSize = ArenaHeap::chunkSize;
+
+    // s_base before the regions are reserved. Nothing a user can hold lies within
+    // reservedSize bytes of it, so contains() is false for every pointer.
+    static constexpr uintptr_t unreservedBase = UINTPTR_MAX - reservedSize;
+
+    static constexpr auto spanReciprocals = makeSpanReciprocals();
+
+    static inline std::atomic<uintptr_t> s_base { unreservedBase };
+
+    // Each class's descriptor array, indexed by span.
+    static inline Arena* s_descriptors[numSizeClasses] = {};
+
+    /**
+     * Where a size class is at in carving up its region. Zeroed, like all static
+     * storage, before first use.
+     */
+    struct ClassRegion {
+        std::mutex lock;
+
+        // Spans below this have been handed out at least once.
+        size_t nextSpan;
+
+        // Bytes of the region below this are accessible.
+        size_t committed;
+
+        // Released spans' descriptors, linked through Arena::m_listNext.
+        Arena* released;
+    };
+
+    static inline ClassRegion s_regions[numSizeClasses];
+
+    // Guards reserving the regions.
+    static inline std::mutex s_reserveLock;
+
+    static char* regionStart(size_t index) {
+        return reinterpret_cast<char*>(s_base.load(std::memory_order_relaxed) + index * regionSize);
+    }
+
+    /**
+     * Reserves the regions and their descriptor arrays if we haven't yet.
+     */
+    static bool reserve() {
+        std::lock_guard<std::mutex> guard(s_reserveLock);
+
+        if (s_base.load(std::memory_order_relaxed) != unreservedBase)
+        {
+            return true;
+        }
+
+        char* range = HugePages::reserve(reservedSize);
+        if (range == nullptr)
+        {
+            return false;
+        }
+
+        for (size_t i = 0; i < numSizeClasses; i++)
+        {
+            size_t spans = regionSize / sizeClasses[i].spanSize;
+            void* descriptors = mmap(nullptr, spans * sizeof(Arena), PROT_READ | PROT_WRITE,
+                                     MAP_ANONYMOUS | MAP_PRIVATE | MAP_NORESERVE, -1, 0);
+            if (descriptors == MAP_FAILED)
+            {
+                for (size_t j = 0; j < i; j++)
+                {
+                    munmap(s_descriptors[j], regionSize / sizeClasses[j].spanSize * sizeof(Arena));
+                }
+                munmap(range, reservedSize);
+                return false;
+            }
+            s_descriptors[i] = static_cast<Arena*>(descriptors);
+        }
+
+        s_base.store(reinterpret_cast<uintptr_t>(range), std::memory_order_release);
+        return true;
+    }
+
+public:
+    /**
+     * Whether `ptr` lies in one of the regions.
+     */
+    static bool contains(const void* ptr) {
+        return reinterpret_cast<uintptr_t>(ptr) - s_base.load(std::memory_order_acquire) < reservedSize;
+    }
+
+    /**
+     * How much of the regions' resident memory is backed by huge pages.
+     */
+    static HugePages::Coverage coverage() {
+        if (s_base.load(std::memory_order_acquire) == unreservedBase)
+        {
+            return {};
+        }
+        return HugePages::coverage(reinterpret_cast<void*>(s_base.load(std::memory_order_relaxed)), reservedSize);
+    }
+
+    /**
+     * The size class whose region holds `ptr`, which must be in the regions.
+     */
+    static size_t sizeClassOf(const void* ptr) {
+        return (reinterpret_cast<uintptr_t>(ptr) - s_base.load(std::memory_order_relaxed)) >> regionShift;
+    }
+
+    /**
+     * Returns the descriptor for the span holding `ptr`, which must be in the
+     * regions. The descriptor is only meaningful if the span is in use.
+     */
+    static Arena* arenaFor(const void* ptr) {
+        uintptr_t offset = reinterpret_cast<uintptr_t>(ptr) - s_base.load(std::memory_order_relaxed);
+        size_t index = offset >> regionShift;
+        uint64_t page = (offset & (regionSize - 1)) >> pageShift;
+
+        return s_descriptors[index] + ((page * spanReciprocals[index]) >> 32);
+    }
+
+    /**
+     * Creates an arena for size class `index` in its region, or returns null if
+     * the region is exhausted.
+     */
+    static Arena* createArena(size_t index, SlotMode mode, ArenaStack* owner) {
+        if (!reserve())
+        {
+            return nullptr;
+        }
+
+        const SizeClass& sizeClass = sizeClasses[index];
+        ClassRegion& region = s_regions[index];
+        size_t span;
+        bool zeroed = true;
+
+        {
+            std::lock_guard<std::mutex> guard(region.lock);
+
+            if (region.released != nullptr)
+            {
+                Arena* arena = region.released;
+                region.released = arena->listNext();
+                span = arena - s_descriptors[index];
+                zeroed = arena->zeroed();
+            }
+            else
+            {
+                if ((region.nextSpan + 1) * sizeClass.spanSize > regionSize)
+                {
+                    return nullptr;
+                }
+
+                span = region.nextSpan;
+                size_t end = (span + 1) * sizeClass.spanSize;
+                if (end > region.committed)
+                {
+                    size_t committed = std::min((end + commitSize - 1) / commitSize * commitSize, regionSize);
+                    if (!HugePages::commit(regionStart(index) + region.committed, committed - region.committed))
+                    {
+                        return nullptr;
+                    }
+                    region.committed = committed;
+                }
+                region.nextSpan++;
+            }
+        }
+
+        return Arena::place(s_descriptors[index] + span, regionStart(index) + span * sizeClass.spanSize,
+                            sizeClass.size, sizeClass.spanSize, mode, owner, zeroed);
+    }
+
+    /**
+     * Gives an arena's span back to its region and the memory to the OS. Only
+     * whole release granules go back, so with huge pages enabled the memory stays
+     * put and the region's huge pages stay whole for the next arena, and with OS
+     * pages bigger than ours a span gives back only the OS pages it covers alone.
+     */
+    static void release(Arena* arena) {
+        size_t index = sizeClassOf(arena->slots());
+        ClassRegion& region = s_regions[index];
+
+        arena->m_zeroed = HugePages::release(arena->slots(), arena->mmapSize(), arena->slots(),
+                                             arena->slots() + arena->mmapSize());
+
+        // Zero the item size so MMapObject::find() knows the span is unused.
+        arena->clear();
+
+        std::lock_guard<std::mutex> guard(region.lock);
+        arena->m_listNext = region.released;
+        region.released = arena;
+    }
+
+    /**
+     * Takes every region's lock ahead of fork(), so the child doesn't inherit
+     * one mid-update. unlockAfterFork() releases them in both parent and child.
+     */
+    static void lockForFork() {
+        s_reserveLock.lock();
+        for (ClassRegion& region : s_regions)
+        {
+            region.lock.lock();
+        }
+    }
+
+    static void unlockAfterFork() {
+        for (ClassRegion& region : s_regions)
+        {
+            region.lock.unlock();
+        }
+        s_reserveLock.unlock();
+    }
+};
+
+inline void Arena::destroy(Arena* arena) {
+    if (SizeClassRegions::contains(arena->m_slots))
+    {
+        SizeClassRegions::release(arena);
+    }
+    else
+    {
+        ArenaHeap::releaseSpan(arena->m_slots, arena->mmapSize() / pageSize);
+        MetadataSlab<Arena>::free(arena);
+    }
+
+    releasedPages();
+}
+
+inline MMapObject* MMapObject::find(const void* ptr) {
+    if (SizeClassRegions::contains(ptr))
+    {
+        MMapObject* arena = SizeClassRegions::arenaFor(ptr);
+        return arena->arenaSize() != 0 ? arena : nullptr;
+    }
+
+    uintptr_t entry = PageMap::get(PageMap::pageOf(ptr));
+    return (entry & PageMap::freeTag) == 0 ? reinterpret_cast<MMapObject*>(entry) : nullptr;
+}
+
+/**
+ * Which of its partial arenas an ArenaStore allocates from once the one it's using
+ * fills up. The choice decides which arenas drain and get given back to the OS.
+ *
+ * MostFull: the one with the fewest free slots, leaving emptier arenas alone so
+ * they can drain.
+ *
+ * LowestAddress: the one lowest in ArenaHeap, which packs live items towards the
+ * start of the heap.
+ *
+ * Newest: the most recently created one, which keeps recent allocations together.
+ */
+enum class ArenaPolicy : uint8_t {
+    MostFull,
+    LowestAddress,
+    Newest
+};
+
+/**
+ * Where an ArenaStore carves new arenas from.
+ *
+ * Heap: ArenaHeap. Freeing an item looks its arena up in the PageMap.
+ *
+ * ClassRegions: the size class's own SizeClassRegions region, falling back to
+ * ArenaHeap once that's exhausted. Freeing an item finds its arena by arithmetic
+ * on the item's address.
+ */
+enum class ArenaLayout : uint8_t {
+    Heap,
+    ClassRegions
+};
+
+class ArenaStore {
+    /**
+     * The arenas with free slots for each size class, indexed by
+     * sizeClassIndex(). Items are allocated from the front one.
+     */
+    ArenaList m_partial[numSizeClasses];
+
+    /**
+     * Arenas with no free slots, parked until something is freed into them.
+     */
+    ArenaList m_full[numSizeClasses];
+
+    /**
+     * Up to maxEmptyArenas arenas with nothing live in them.
+     */
+    ArenaList m_empty[numSizeClasses];
+
+    // Parked arenas that other threads have since freed into. This also identifies
+    // the store as the owner of its arenas.
+    ArenaStack m_reclaimed;
+
+    // How newly created arenas track their free slots.
+    SlotMode m_slotMode = SlotMode::FreeList;
+
+    // Which partial arena to allocate from next.
+    ArenaPolicy m_policy = ArenaPolicy::MostFull;
+
+    // Where newly created arenas are carved from.
+    ArenaLayout m_layout = ArenaLayout::Heap;
+
+    /**
+     * Running totals for the arenas this store has created and given back.
+     */
+    struct ArenaStats {
+        size_t arenasCreated;
+        size_t pagesMapped;
+        size_t arenasReleased;
+        size_t pagesReleased;
+    };
+
+    ArenaStats m_arenaStats = {};
+
+    /**
+     * Running totals for the requests served by one size class.
+     */
+    struct SizeClassStats {
+        size_t allocations;
+        size_t requestedBytes;
+        size_t reservedBytes;
+    };
+
+    // Indexed by sizeClassIndex(). The last entry tracks BigAllocs.
+    SizeClassStats m_stats[numSizeClasses + 1] = {};
+
+    // Big allocations this store has freed, for it to reuse.
+    BigAllocCache m_bigCache { BigAllocCache::threadCapacity, &BigAllocCache::global(), false };
+
+    /**
+     * Keeps an arena with nothing live in it in the empty cache for its class, or
+     * destroys it if the cache is full.
+     */
+    void releaseEmpty(size_t index, Arena* arena) {
+        if (m_empty[index].size() < maxEmptyArenas)
+        {
+            m_empty[index].pushFront(arena);
+        }
+        else
+        {
+            m_arenaStats.arenasReleased++;
+            m_arenaStats.pagesReleased += arena->mmapSize() / pageSize;
+            Arena::destroy(arena);
+        }
+    }
+
+    /**
+     * Whether `arena` should be allocated from before `other` under the store's
+     * ArenaPolicy.
+     */
+    bool preferArena(Arena* arena, Arena* other) {
+        switch (m_policy)
+        {
+        case ArenaPolicy::MostFull:
+            return arena->freeSlots() < other->freeSlots();
+        case ArenaPolicy::LowestAddress:
+            return arena->slots() < other->slots();
+        case ArenaPolicy::Newest:
+            return arena->serial() > other->serial();
+        }
+        return false;
+    }
+
+    /**
+     * Puts an arena that has free slots again on the partial list for size class
+     * `index`, at the front if the ArenaPolicy prefers it to the one there.
+     */
+    void addPartial(size_t index, Arena* arena) {
+        Arena* front = m_partial[index].front();
+        if (front != nullptr && preferArena(arena, front))
+        {
+            m_partial[index].pushFront(arena);
+            releaseIfEmpty(index, front);
+        }
+        else
+        {
+            m_partial[index].pushBack(arena);
+        }
+    }
+
+    /**
+     * Takes an arena that's no longer at the front of the partial list for size
+     * class `index` off the list if nothing in it is live. The front arena is
+     * kept even when empty, since it's about to be allocated from.
+     */
+    void releaseIfEmpty(size_t index, Arena* arena) {
+        if (arena->empty())
+        {
+            m_partial[index].remove(arena);
+            releaseEmpty(index, arena);
+        }
+    }
+
+    /**
+     * Moves the partial arena for size class `index` that the ArenaPolicy prefers
+     * to the front. This scans the list, but only runs when the arena being
+     * allocated from fills up or the list is refilled; in between, arenas that
+     * come back to the list only go in front if they beat the current one.
+     */
+    void selectArena(size_t index) {
+        Arena* best = m_partial[index].front();
+        if (best == nullptr || m_partial[index].size() == 1)
+        {
+            return;
+        }
+
+        for (Arena* arena = best->listNext(); arena != nullptr; arena = arena->listNext())
+        {
+            if (preferArena(arena, best))
+            {
+                best = arena;
+            }
+        }
+
+        Arena* front = m_partial[index].front();
+        if (best != front)
+        {
+            m_partial[index].remove(best);
+            m_partial[index].pushFront(best);
+            releaseIfEmpty(index, front);
+        }
+    }
+
+    /**
+     * Moves the arenas other threads have freed into since they were parked back
+     * onto their partial lists.
+     */
+    void takeReclaimed() {
+        Arena* arena = m_reclaimed.takeAll();
+        while (arena != nullptr)
+        {
+            Arena* next = arena->stackNext();
+            size_t index = sizeClassIndex(arena->arenaSize());
+
+            arena->unqueue();
+            m_full[index].remove(arena);
+
+            if (arena->empty() && !m_partial[index].empty())
+            {
+                releaseEmpty(index, arena);
+            }
+            else
+            {
+                addPartial(index, arena);
+            }
+
+            arena = next;
+        }
+    }
+
+    /**
+     * Finds an arena with free slots for size class `index` when the partial
+     * list has run dry: first one freed into by another thread, then a cached
+     * empty one, and only then a new one. Returns false if ArenaHeap is exhausted.
+     */
+    bool refill(size_t index) {
+        takeReclaimed();
+        if (!m_partial[index].empty())
+        {
+            selectArena(index);
+            return true;
+        }
+
+        Arena* arena = m_empty[index].front();
+        if (arena != nullptr)
+        {
+            m_empty[index].remove(arena);
+        }
+        else
+        {
+            if (m_layout == ArenaLayout::ClassRegions)
+            {
+                arena = SizeClassRegions::createArena(index, m_slotMode, &m_reclaimed);
+            }
+            if (arena == nullptr)
+            {
+                arena = Arena::create(sizeClasses[index].size, sizeClasses[index].spanSize, m_slotMode, &m_reclaimed);
+            }
+            if (arena == nullptr)
+            {
+                return false;
+            }
+
+            arena->setSerial(m_arenaStats.arenasCreated++);
+            m_arenaStats.pagesMapped += sizeClasses[index].spanSize / pageSize;
+        }
+
+        m_partial[index].pushFront(arena);
+        return true;
+    }
+
+    /**
+     * Counts a request for `bytes` bytes served by size class `index`, or by a big
+     * allocation if `index` is numSizeClasses. Only built with MALLOC_STATS, so
+     * the inlined allocation path stays a free list pop.
+     */
+    void countRequest(size_t index, size_t bytes) {
+#ifdef MALLOC_STATS
+        m_stats[index].allocations++;
+        m_stats[index].requestedBytes += bytes;
+        m_stats[index].reservedBytes += index < numSizeClasses ? sizeClasses[index].size
+                                                               : bytes <= BigAlloc::maxSize ? BigAlloc::pagesFor(bytes) * pageSize : bytes;
+#else
+        (void)index;
+        (void)bytes;
+#endif
+    }
+
+    /**
+     * Allocates an item from the front arena for size class `index`. Once an
+     * arena has handed out every slot it's parked on the full list, and comes
+     * back to the partial list when something is freed into it. If ArenaHeap is
+     * exhausted, the item is served by BigAlloc instead. If `zeroed` isn't null,
+     * it's set to whether the item is known to be zero: a never-touched slot in a
+     * span that was zero, or a fresh big allocation.
+     */
+    void* allocFromArena(size_t index, bool* zeroed = nullptr) {
+        if (m_partial[index].empty() && !refill(index))
+        {
+            return BigAlloc::alloc(sizeClasses[index].size, pageSize, zeroed);
+        }
+
+        Arena* arena = m_partial[index].front();
+        char* untouched = arena->next();
+        void* ptr = arena->alloc();
+
+        if (zeroed != nullptr)
+        {
+            *zeroed = arena->zeroed() && ptr >= untouched;
+        }
+
+        if (arena->full() && arena->park())
+        {
+            m_partial[index].remove(arena);
+            m_full[index].pushBack(arena);
+            selectArena(index);
+        }
+        return ptr;
+    }
+
+    /**
+     * Handles a free by the owner that may have moved `arena` between lists: into
+     * a parked arena, which can go back on the partial list, or emptying an arena
+     * that isn't the one being allocated from.
+     */
+    void freedIntoIdleArena(Arena* arena) {
+        size_t index = sizeClassIndex(arena->arenaSize());
+
+        if (arena->isParked())
+        {
+            // If another thread queued it first, it comes back when we take it off
+            // the stack.
+            if (!arena->unpark())
+            {
+                return;
+            }
+            m_full[index].remove(arena);
+            addPartial(index, arena);
+        }
+
+        if (m_partial[index].front() != arena)
+        {
+            releaseIfEmpty(index, arena);
+        }
+    }
+
+    /**
+     * Returns the item at `ptr` to `arena`, without atomics if it's one of ours.
+     */
+    void freeToArena(Arena* arena, void* ptr) {
+        if (arena->owner() == &m_reclaimed)
+        {
+            arena->freeLocal(ptr);
+            if (arena->empty() || arena->isParked())
+            {
+                freedIntoIdleArena(arena);
+            }
+        }
+        else if (arena->free(ptr))
+        {
+            Arena::destroy(arena);
+        }
+    }
+
+public:
+    ArenaStore() = default;
+    ArenaStore(const ArenaStore& other) = delete;
+
+    /**
+     * Retires this store's arenas. Items in them that are still live may be freed
+     * later from any thread.
+     */
+    ~ArenaStore() {
+        // Parked arenas can be queued on m_reclaimed by other threads, so unpark
+        // them all first, and wait for any that are already on their way.
+        size_t queued = 0;
+        for (ArenaList& list : m_full)
+        {
+            for (Arena* arena = list.front(); arena != nullptr; arena = arena->listNext())
+            {
+                if (!arena->unpark())
+                {
+                    queued++;
+                }
+            }
+        }
+
+        while (queued > 0)
+        {
+            for (Arena* arena = m_reclaimed.takeAll(); arena != nullptr; arena = arena->stackNext())
+            {
+                queued--;
+            }
+        }
+
+        for (ArenaList* lists : {m_partial, m_full, m_empty})
+        {
+            for (size_t i = 0; i < numSizeClasses; i++)
+            {
+                Arena* arena = lists[i].front();
+                while (arena != nullptr)
+                {
+                    Arena* next = arena->listNext();
+                    if (arena->retire())
+                    {
+                        Arena::destroy(arena);
+                    }
+                    arena = next;
+                }
+            }
+        }
+    }
+
+    /**
+     * Sets how arenas opened from now on track their free slots. Arenas that are
+     * already open keep their mode.
+     */
+    void setSlotMode(SlotMode mode) {
+        m_slotMode = mode;
+    }
+
+    /**
+     * Sets where arenas created from now on are carved from. Existing arenas stay
+     * where they are.
+     */
+    void setArenaLayout(ArenaLayout layout) {
+        m_layout = layout;
+    }
+
+    /**
+     * Sets which partial arena to allocate from once the current one fills up.
+     */
+    void setArenaPolicy(ArenaPolicy policy) {
+        m_policy = policy;
+    }
+
+    /**
+     * The number of arenas this store has created, and how many of their pages
+     * it has given back to the OS after they emptied out.
+     */
+    const ArenaStats& arenaStats() {
+        return m_arenaStats;
+    }
+
+    /**
+     * Allocates `bytes` bytes of data. If the data is too large to fit in an arena,
+     * it will be allocated using BigAlloc, reusing a cached allocation of the same
+     * number of pages if there is one.
+     */
+    void* alloc(size_t bytes) {
+        if (bytes > maxArenaItemSize)
+        {
+            countRequest(numSizeClasses, bytes);
+
+            void* ptr = bytes <= BigAllocCache::maxCachedSize ? m_bigCache.alloc(bytes, BigAllocCache::now()) : nullptr;
+            return ptr != nullptr ? ptr : BigAlloc::alloc(bytes);
+        }
+
+        size_t index = sizeClassIndex(bytes);
+        countRequest(index, bytes);
+        return allocFromArena(index);
+    }
+
+    /**
+     * alloc()'s common case, cheap enough to inline at every call: an item of a
+     * size class taken from the front arena without filling it up. Returns null
+     * when that won't do, for alloc() to handle.
+     */
+    void* allocFast(size_t bytes) {
+        if (bytes > maxArenaItemSize)
+        {
+            return nullptr;
+        }
+
+        size_t index = sizeClassIndex(bytes);
+        Arena* arena = m_partial[index].front();
+        if (arena == nullptr)
+        {
+            return nullptr;
+        }
+
+        void* ptr = arena->allocFast();
+        if (ptr != nullptr)
+        {
+            countRequest(index, bytes);
+        }
+        return ptr;
+    }
+
+    /**
+     * free()'s common case, cheap enough to inline at every call: an item going
+     * back to one of this store's arenas that stays on the list it's on. Returns
+     * false when that won't do, having done nothing, for free() to handle.
+     */
+    bool freeFast(void* ptr) {
+        MMapObject* obj = MMapObject::find(ptr);
+        if (obj == nullptr || obj->arenaSize() == 0)
+        {
+            return false;
+        }
+
+        Arena* arena = static_cast<Arena*>(obj);
+        return arena->owner() == &m_reclaimed && arena->freeLocalFast(ptr);
+    }
+
+    /**
+     * freeFast() for an item allocated with `bytes` bytes aligned to `alignment`,
+     * or with alloc() if `alignment` is 1. Items are usually freed while their
+     * size class is still allocating from the arena they came from, and then
+     * that arena is found from the size without the page map. Returns false when
+     * that won't do, having done nothing, for freeSized() to handle.
+     */
+    bool freeSizedFast(void* ptr, size_t bytes, size_t alignment) {
+        if (bytes > maxArenaItemSize || alignment > pageSize)
+        {
+            return false;
+        }
+
+        // Aligned allocations no class fits are big allocations.
+        size_t index = alignedSizeClassIndex(bytes, alignment);
+        if (index == numSizeClasses)
+        {
+            return false;
+        }
+
+        Arena* arena = m_partial[index].front();
+        if (arena == nullptr || !arena->contains(ptr))
+        {
+            // Resized in place, or from an arena the class has moved on from.
+            return freeFast(ptr);
+        }
+        return arena->freeLocalFast(ptr);
+    }
+
+    /**
+     * Allocates `bytes` bytes aligned to `alignment`, which must be a power of two.
+     * Alignments up to pageSize are served from the smallest size class whose
+     * items are all aligned, so they cost no padding; bigger ones, and requests
+     * too big for an arena, get an aligned BigAlloc.
+     */
+    void* allocAligned(size_t bytes, size_t alignment) {
+        if (alignment <= pageSize)
+        {
+            size_t index = alignedSizeClassIndex(bytes, alignment);
+            if (index < numSizeClasses)
+            {
+                countRequest(index, bytes);
+                return allocFromArena(index);
+            }
+        }
+
+        countRequest(numSizeClasses, bytes);
+        return BigAlloc::alloc(bytes, std::max(alignment, pageSize));
+    }
+
+    /**
+     * The number of bytes the allocation at `ptr` can really hold: its slot if
+     * it's an arena item, or its whole pages if it's a big allocation. Returns 0
+     * for null or pointers we didn't hand out.
+     */
+    static size_t usableSize(const void* ptr) {
+        MMapObject* obj = MMapObject::find(ptr);
+        return obj != nullptr ? capacityOf(obj) : 0;
+    }
+
+    /**
+     * The usable size an allocation of `bytes` bytes would get: its size class,
+     * or for big allocations, whole pages. Like nallocx(), it allocates nothing.
+     */
+    static size_t goodSize(size_t bytes) {
+        if (bytes > maxArenaItemSize)
+        {
+            size_t rounded = (bytes + pageSize - 1) & ~(pageSize - 1);
+            return rounded >= bytes ? rounded : bytes;
+        }
+        return sizeClasses[sizeClassIndex(bytes)].size;
+    }
+
+    /**
+     * Allocates at least `bytes` bytes, as much as goodSize() says the allocation
+     * can hold anyway, and sets `actual` to that, so the caller can use the slack.
+     * Free it with free(), or freeSized() and either size.
+     */
+    void* allocAtLeast(size_t bytes, size_t& actual) {
+        size_t size = goodSize(bytes);
+        void* ptr = alloc(size);
+        actual = ptr != nullptr ? size : 0;
+        return ptr;
+    }
+
+    /**
+     * Allocates zeroed space for `count` items of `size` bytes each, or returns
+     * null if that many bytes would overflow a size_t. Only recycled memory is
+     * zeroed by hand; never-touched slots and fresh pages are already zero, so a
+     * big calloc costs nothing until its pages are touched.
+     */
+    void* calloc(size_t count, size_t size) {
+        size_t bytes;
+        if (__builtin_mul_overflow(count, size, &bytes))
+        {
+            return nullptr;
+        }
+
+        void* ptr;
+        bool zeroed = false;
+        if (bytes > maxArenaItemSize)
+        {
+            countRequest(numSizeClasses, bytes);
+
+            // Cached allocations were someone's data.
+            ptr = bytes <= BigAllocCache::maxCachedSize ? m_bigCache.alloc(bytes, BigAllocCache::now()) : nullptr;
+            if (ptr == nullptr)
+            {
+                ptr = BigAlloc::alloc(bytes, pageSize, &zeroed);
+            }
+        }
+        else
+        {
+            size_t index = sizeClassIndex(bytes);
+            countRequest(index, bytes);
+            ptr = allocFromArena(index, &zeroed);
+        }
+
+        if (ptr != nullptr && !zeroed)
+        {
+            memset(ptr, 0, bytes);
+        }
+        return ptr;
+    }
+
+    /**
+     * Resizes the allocation at `ptr` to `bytes` bytes, keeping its contents up to
+     * the smaller of the two sizes, and returns where it is now. An arena item
+     * stays put while `bytes` still fits its slot, and a big allocation is resized
+     * in place or remapped where it can be; anything else moves to a new
+     * allocation. Like realloc(), a null `ptr` allocates and a zero `bytes` frees
+     * and returns null. Returns null, leaving the allocation alone, if we're out
+     * of memory or `ptr` isn't ours.
+     */
+    void* realloc(void* ptr, size_t bytes) {
+        if (ptr == nullptr)
+        {
+            return alloc(bytes);
+        }
+
+        if (bytes == 0)
+        {
+            free(ptr);
+            return nullptr;
+        }
+
+        MMapObject* obj = MMapObject::find(ptr);
+        if (obj == nullptr || bytes > BigAlloc::maxSize)
+        {
+            return nullptr;
+        }
+
+        size_t capacity = capacityOf(obj);
+        if (obj->arenaSize() != 0)
+        {
+            if (bytes <= capacity)
+            {
+                return ptr;
+            }
+        }
+        else
+        {
+            BigAlloc* big = static_cast<BigAlloc*>(obj);
+
+            // Shrinking into a size class is better served by an arena.
+            if (bytes > maxArenaItemSize && BigAlloc::resize(big, bytes))
+            {
+                return big->data();
+            }
+        }
+
+        void* fresh = alloc(bytes);
+        if (fresh == nullptr)
+        {
+            return nullptr;
+        }
+
+        memcpy(fresh, ptr, std::min(capacity, bytes));
+        free(ptr);
+        return fresh;
+    }
+
+    /**
+     * Writes a table of how many bytes were requested from each size class versus
+     * how many bytes of slots were reserved to serve them, i.e. the internal
+     * fragmentation each class has cost over the lifetime of this store. Big
+     * allocations reserve their request rounded up to whole pages. Requests are
+     * only counted when built with MALLOC_STATS, so otherwise the table is empty.
+     * Ends with how much of the arenas' resident memory huge pages back, per
+     * /proc/self/smaps.
+     */
+    void report(std::ostream& out) {
+        size_t totalRequested = 0;
+        size_t totalReserved = 0;
+
+#ifndef MALLOC_STATS
+        out << "requests not counted; build with MALLOC_STATS to count them" << std::endl;
+#endif
+        out << "class\tallocs\trequested\treserved\twaste" << std::endl;
+
+        for (size_t i = 0; i <= numSizeClasses; i++)
+        {
+            const SizeClassStats& stats = m_stats[i];
+            if (stats.allocations == 0)
+            {
+                continue;
+            }
+
+            if (i < numSizeClasses)
+            {
+                out << sizeClasses[i].size;
+            }
+            else
+            {
+                out << "big";
+            }
+            out << "\t" << stats.allocations
+                << "\t" << stats.requestedBytes
+                << "\t" << stats.reservedBytes
+                << "\t" << 100.0 * (stats.reservedBytes - stats.requestedBytes) / stats.reservedBytes << "%" << std::endl;
+
+            totalRequested += stats.requestedBytes;
+            totalReserved += stats.reservedBytes;
+        }
+
+        if (totalReserved != 0)
+        {
+            out << "total\t\t" << totalRequested << "\t" << totalReserved << "\t"
+                << 100.0 * (totalReserved - totalRequested) / totalReserved << "%" << std::endl;
+        }
+
+        out << "arenas created\t" << m_arenaStats.arenasCreated << "\t" << m_arenaStats.pagesMapped << " pages" << std::endl;
+        out << "arenas released\t" << m_arenaStats.arenasReleased << "\t" << m_arenaStats.pagesReleased << " pages" << std::endl;
+        out << "big cache\t" << m_bigCache.hits() << " hits\t" << m_bigCache.misses() << " misses\t"
+            << m_bigCache.bytes() << " bytes cached" << std::endl;
+
+        // Huge pages are process-wide, so this covers every store's arenas.
+        HugePages::Coverage heap = ArenaHeap::coverage();
+        HugePages::Coverage regions = SizeClassRegions::coverage();
+        size_t resident = heap.residentBytes + regions.residentBytes;
+        size_t huge = heap.hugeBytes + regions.hugeBytes;
+        out << "huge pages\t" << (huge >> 10) << " of " << (resident >> 10) << " kB resident\t"
+            << (resident != 0 ? 100.0 * huge / resident : 0.0) << "%" << std::endl;
+    }
+
+    /**
+     * Determines the allocation type for the given pointer and calls
+     * the appropriate free method. The pointer's arena or big allocation is found
+     * through the PageMap, so this never reads the item's page for metadata, and
+     * pointers we didn't hand out are ignored. Items from this store's own arenas are
+     * freed without any atomic operations. Big allocations are kept in this store's
+     * BigAllocCache while they fit.
+     */
+    void free(void* ptr) {
+        // Items in a size class region find their arena without loading anything.
+        if (SizeClassRegions::contains(ptr))
+        {
+            freeToArena(SizeClassRegions::arenaFor(ptr), ptr);
+            return;
+        }
+
+        MMapObject* obj = MMapObject::find(ptr);
+        if (obj == nullptr)
+        {
+            // Null, or not ours.
+            return;
+        }
+
+        if (obj->arenaSize() != 0)
+        {
+            freeToArena(static_cast<Arena*>(obj), ptr);
+        }
+        else
+        {
+            m_bigCache.free(static_cast<BigAlloc*>(obj), BigAllocCache::now());
+        }
+    }
+
+    /**
+     * Frees `ptr` without a store, the way another thread would: arena items go
+     * back to their arena's owner, and big allocations go straight back to the
+     * heap or the OS. For threads that haven't made their store yet, or have
+     * already torn it down.
+     */
+    static void freeUnowned(void* ptr) {
+        MMapObject* obj = MMapObject::find(ptr);
+        if (obj == nullptr)
+        {
+            return;
+        }
+
+        if (obj->arenaSize() != 0)
+        {
+            Arena* arena = static_cast<Arena*>(obj);
+            if (arena->free(ptr))
+            {
+                Arena::destroy(arena);
+            }
+        }
+        else
+        {
+            BigAlloc::free(static_cast<BigAlloc*>(obj));
+        }
+    }
+
+    /**
+     * Frees `ptr`, which was allocated with `bytes` bytes, or resized to them.
+     * Knowing the size saves working out what kind of allocation `ptr` is: one
+     * too big for an arena can only be a big allocation, and one in a size class
+     * region can only be an arena item. Smaller ones may still be big allocations
+     * that were aligned or made when the heap ran out, so those are checked.
+     *
+     * Built with MALLOC_VERIFY_SIZES, this checks `bytes` against the
+     * allocation's metadata first, and raises SIGTRAP if they disagree.
+     */
+    void freeSized(void* ptr, size_t bytes) {
+        if (ptr == nullptr)
+        {
+            return;
+        }
+
+#ifdef MALLOC_VERIFY_SIZES
+        verifySize(ptr, bytes);
+#endif
+
+        if (bytes > maxArenaItemSize)
+        {
+            uintptr_t entry = PageMap::get(PageMap::pageOf(ptr));
+            m_bigCache.free(reinterpret_cast<BigAlloc*>(entry), BigAllocCache::now());
+            return;
+        }
+
+        if (SizeClassRegions::contains(ptr))
+        {
+            freeToArena(SizeClassRegions::arenaFor(ptr), ptr);
+            return;
+        }
+
+        MMapObject* obj = reinterpret_cast<MMapObject*>(PageMap::get(PageMap::pageOf(ptr)));
+        if (obj->arenaSize() != 0)
+        {
+            freeToArena(static_cast<Arena*>(obj), ptr);
+        }
+        else
+        {
+            m_bigCache.free(static_cast<BigAlloc*>(obj), BigAllocCache::now());
+        }
+    }
+
+private:
+    /**
+     * The number of bytes the allocation `obj` describes can really hold.
+     */
+    static size_t capacityOf(MMapObject* obj) {
+        if (obj->arenaSize() != 0)
+        {
+            return obj->arenaSize();
+        }
+        return BigAlloc::pagesFor(obj->mmapSize()) * pageSize;
+    }
+
+    /**
+     * Raises SIGTRAP unless `ptr` is an allocation we handed out that `bytes`
+     * bytes could have been asked for: no more than an arena item's slot, or
+     * between a big allocation's size and its usable size. Big allocations
+     * standing in for arena items when the heap ran out are sized to the slot, so
+     * they're treated like one.
+     */
+    static void verifySize(void* ptr, size_t bytes) {
+        MMapObject* obj = MMapObject::find(ptr);
+
+        bool matches;
+        if (obj == nullptr)
+        {
+            matches = false;
+        }
+        else if (obj->arenaSize() != 0)
+        {
+            matches = bytes <= obj->arenaSize();
+        }
+        else
+        {
+            size_t size = obj->mmapSize();
+            matches = static_cast<BigAlloc*>(obj)->data() == ptr && bytes <= capacityOf(obj) &&
+                      (bytes >= size || size <= maxArenaItemSize);
+        }
+
+        if (!matches)
+        {
+            std::cerr << "freeSized(" << ptr << ", " << bytes << ") doesn't match the allocation" << std::endl;
+            raise(SIGTRAP);
+        }
+    }
 };
 
-void* myMalloc(size_t n);
-void myFree(void* ptr);
\ No newline at end of file
+// This thread's store, made on first use by myMallocSlow(). It's declared here
+// so that myMalloc() and myFree() can reach it inline. Initial-exec TLS makes
+// that one load off the thread pointer, even from libmymalloc.so, where the
+// default model would call __tls_get_addr() every time.
+extern __thread ArenaStore* t_store __attribute__((tls_model("initial-exec")));
+
+/**
+ * Everything myMalloc() and myFree() don't handle inline: big allocations, new
+ * arenas, parking arenas, freeing into other threads' arenas, and making the
+ * thread's store in the first place.
+ */
+__attribute__((noinline, cold)) void* myMallocSlow(size_t n);
+__attribute__((noinline, cold)) void myFreeSlow(void* ptr);
+
+/**
+ * Your special drop-in replacement for malloc(). Should behave the same way.
+ */
+inline void* myMalloc(size_t n) {
+    ArenaStore* store = t_store;
+    void* ptr = store != nullptr ? store->allocFast(n) : nullptr;
+    return __builtin_expect(ptr != nullptr, 1) ? ptr : myMallocSlow(n);
+}
+
+/**
+ * Your special drop-in replacement for free(). Should behave the same way.
+ */
+inline void myFree(void* ptr) {
+    ArenaStore* store = t_store;
+    if (__builtin_expect(store == nullptr || !store->freeFast(ptr), 0))
+    {
+        myFreeSlow(ptr);
+    }
+}
+
+__attribute__((noinline, cold)) void myFreeSizedSlow(void* ptr, size_t n);
+
+/**
+ * Frees `ptr`, which was allocated with `n` bytes aligned to `alignment`, like
+ * free_aligned_sized() in C23; pass 1 for allocations that weren't aligned.
+ * Knowing the size class, the free usually skips the page map.
+ */
+inline void myFreeAlignedSized(void* ptr, size_t alignment, size_t n) {
+#ifndef MALLOC_VERIFY_SIZES
+    ArenaStore* store = t_store;
+    if (__builtin_expect(store != nullptr && store->freeSizedFast(ptr, n, alignment), 1))
+    {
+        return;
+    }
+#endif
+    myFreeSizedSlow(ptr, n);
+}
+
+/**
+ * Frees `ptr`, which was allocated with `n` bytes, like free_sized() in C23.
+ */
+inline void myFreeSized(void* ptr, size_t n) {
+    myFreeAlignedSized(ptr, 1, n);
+}
+void* myRealloc(void* ptr, size_t n);
+void* myCalloc(size_t count, size_t size);
+void* myAlignedAlloc(size_t alignment, size_t n);
+int myPosixMemalign(void** result, size_t alignment, size_t n);
+void* myMemalign(size_t alignment, size_t n);
+void* myValloc(size_t n);
+void* myPvalloc(size_t n);
+size_t myMallocUsableSize(void* ptr);
+size_t myGoodSize(size_t n);
+void* myMallocAtLeast(size_t n, size_t* actual);
+
+/**
+ * Writes the calling thread's requested vs reserved bytes per size class.
+ */
+void myMallocReport(std::ostream& out);
\ No newline at end of file
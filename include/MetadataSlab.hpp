@@ -0,0 +1,87 @@
+#pragma once
+
+#include <cstddef>
+#include <mutex>
+#include <sys/mman.h>
+
+#include <Page.hpp>
+
+/**
+ * Hands out storage for fixed-size allocator metadata of type T, such as arena
+ * descriptors, so that metadata lives apart from the memory it describes.
+ * Storage is carved from mmapped chunks and recycled through a free list, but
+ * never returned to the OS; metadata is small and the count of live objects
+ * is bounded by the memory they describe.
+ *
+ * The storage is uninitialized. Callers overlay T onto it, as with MMapObject.
+ */
+template <typename T> class MetadataSlab {
+    // A recycled object's storage, threaded into a LIFO list.
+    struct FreeObject {
+        FreeObject* next;
+    };
+
+    // Objects are padded so each one starts suitably aligned.
+    static constexpr size_t objectSize = (sizeof(T) + alignof(T) - 1) / alignof(T) * alignof(T);
+
+    // The number of bytes mapped at a time.
+    static constexpr size_t chunkSize = 16 * pageSize;
+
+    static_assert(objectSize >= sizeof(FreeObject), "Metadata too small to recycle");
+    static_assert(objectSize <= chunkSize, "Metadata too big for a slab chunk");
+
+    static inline std::mutex s_lock;
+    static inline FreeObject* s_freeList = nullptr;
+    static inline char* s_next = nullptr;
+    static inline char* s_end = nullptr;
+
+public:
+    /**
+     * Returns storage for one T, or null if we're out of memory.
+     */
+    static T* alloc() {
+        std::lock_guard<std::mutex> guard(s_lock);
+
+        if (s_freeList != nullptr) {
+            FreeObject* obj = s_freeList;
+            s_freeList = obj->next;
+            return reinterpret_cast<T*>(obj);
+        }
+
+        if (s_next == nullptr || s_next + objectSize > s_end) {
+            void* chunk = mmap(nullptr, chunkSize, PROT_READ | PROT_WRITE, MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+            if (chunk == MAP_FAILED) {
+                return nullptr;
+            }
+            s_next = static_cast<char*>(chunk);
+            s_end = s_next + chunkSize;
+        }
+
+        T* obj = reinterpret_cast<T*>(s_next);
+        s_next += objectSize;
+        return obj;
+    }
+
+    /**
+     * Returns storage from alloc() for reuse.
+     */
+    static void free(T* obj) {
+        std::lock_guard<std::mutex> guard(s_lock);
+
+        FreeObject* freed = reinterpret_cast<FreeObject*>(obj);
+        freed->next = s_freeList;
+        s_freeList = freed;
+    }
+
+    /**
+     * Takes the slab's lock ahead of fork(), so the child doesn't inherit it
+     * mid-update. unlockAfterFork() releases it in both parent and child.
+     */
+    static void lockForFork() {
+        s_lock.lock();
+    }
+
+    static void unlockAfterFork() {
+        s_lock.unlock();
+    }
+};
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstddef>
+#include <unistd.h>
+
+// The allocator's page: the unit spans, arenas and the page map work in. It's
+// a compile-time constant so the hot paths' masks and shifts fold away. It
+// defaults to 4 KiB; build with -DMALLOC_PAGE_SIZE=16384 or 65536 to match
+// hosts with bigger pages. It needn't match the OS's page size, see
+// systemPageSize().
+#ifndef MALLOC_PAGE_SIZE
+#define MALLOC_PAGE_SIZE 4096
+#endif
+
+constexpr size_t pageSize = MALLOC_PAGE_SIZE;
+
+static_assert(pageSize == 4096 || pageSize == 16384 || pageSize == 65536,
+              "MALLOC_PAGE_SIZE must be 4 KiB, 16 KiB or 64 KiB");
+
+// Arenas for large size classes span several pages, up to this many.
+constexpr size_t maxSpanPages = 32;
+
+/**
+ * The OS's page size, read with sysconf() on first use. On arm64 hosts it may
+ * be 16 KiB or 64 KiB, bigger than pageSize, in which case memory can only go
+ * back to the OS in whole OS pages, never a span's share of one.
+ */
+inline size_t systemPageSize() {
+    static const size_t size = sysconf(_SC_PAGESIZE);
+    return size;
+}
@@ -0,0 +1,115 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <sys/mman.h>
+
+#include <Page.hpp>
+
+/**
+ * Maps every page of the address space to the metadata describing the memory on
+ * it, so any pointer can be traced to its arena or big allocation without reading
+ * the memory it points to, and pointers we never handed out are recognized by
+ * finding nothing.
+ *
+ * It's a two-level radix tree keyed by page number. The root is a static array
+ * of leaf pointers; leaves are mmapped on first use and never freed, and only the
+ * parts of them covering pages in use are ever touched. Lookups are two dependent
+ * loads and take no locks. Leaves are installed with a compare-and-swap, so
+ * threads racing to create the same one agree on a single winner.
+ */
+class PageMap {
+    // Pointers are at most this many bits wide on the platforms we support.
+    static constexpr size_t addressBits = 48;
+
+    static constexpr size_t pageShift = __builtin_ctzll(pageSize);
+
+    // Each leaf covers 2^leafBits pages, 1 GiB with 4 KiB pages.
+    static constexpr size_t leafBits = 18;
+    static constexpr size_t leafEntries = size_t(1) << leafBits;
+
+    static constexpr size_t rootBits = addressBits - pageShift - leafBits;
+    static constexpr size_t rootEntries = size_t(1) << rootBits;
+
+    static inline std::atomic<std::atomic<uintptr_t>*> s_root[rootEntries] = {};
+
+    /**
+     * Returns the leaf covering page number `page`, creating it if `create` is set.
+     * Returns null if there isn't one, or it couldn't be created.
+     */
+    static std::atomic<uintptr_t>* leafFor(uintptr_t page, bool create) {
+        if (page >> (rootBits + leafBits) != 0) {
+            return nullptr;
+        }
+
+        std::atomic<uintptr_t>* leaf = s_root[page >> leafBits].load(std::memory_order_acquire);
+        if (leaf != nullptr || !create) {
+            return leaf;
+        }
+
+        void* fresh = mmap(nullptr, leafEntries * sizeof(uintptr_t), PROT_READ | PROT_WRITE,
+                           MAP_ANONYMOUS | MAP_PRIVATE | MAP_NORESERVE, -1, 0);
+        if (fresh == MAP_FAILED) {
+            return nullptr;
+        }
+
+        leaf = static_cast<std::atomic<uintptr_t>*>(fresh);
+        std::atomic<uintptr_t>* expected = nullptr;
+        if (!s_root[page >> leafBits].compare_exchange_strong(expected, leaf, std::memory_order_acq_rel)) {
+            // Someone else installed it first.
+            munmap(fresh, leafEntries * sizeof(uintptr_t));
+            leaf = expected;
+        }
+
+        return leaf;
+    }
+
+public:
+    // Entries with this bit set describe free pages for the heap's own
+    // bookkeeping, and never point to an MMapObject.
+    static constexpr uintptr_t freeTag = 1;
+
+    /**
+     * The page number of the page holding `address`.
+     */
+    static uintptr_t pageOf(const void* address) {
+        return reinterpret_cast<uintptr_t>(address) >> pageShift;
+    }
+
+    /**
+     * Returns the entry for page number `page`, or 0 if nothing was ever set there.
+     */
+    static uintptr_t get(uintptr_t page) {
+        std::atomic<uintptr_t>* leaf = leafFor(page, false);
+        return leaf != nullptr ? leaf[page & (leafEntries - 1)].load(std::memory_order_relaxed) : 0;
+    }
+
+    /**
+     * Makes sure there are leaves for `count` pages starting at page number `first`,
+     * so set() on them can't fail. Returns false if a leaf couldn't be created.
+     */
+    static bool ensure(uintptr_t first, size_t count) {
+        for (uintptr_t page = first; page < first + count; page = (page | (leafEntries - 1)) + 1) {
+            if (leafFor(page, true) == nullptr) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    /**
+     * Sets the entries for `count` pages starting at page number `first` to
+     * `value`. Returns false if a leaf couldn't be created.
+     */
+    static bool set(uintptr_t first, size_t count, uintptr_t value) {
+        for (uintptr_t page = first; page < first + count; page++) {
+            std::atomic<uintptr_t>* leaf = leafFor(page, true);
+            if (leaf == nullptr) {
+                return false;
+            }
+            leaf[page & (leafEntries - 1)].store(value, std::memory_order_relaxed);
+        }
+        return true;
+    }
+};
@@ -0,0 +1,124 @@
+#include <Malloc.hpp>
+#include <new>
+
+// Replacements for every replaceable operator new and operator delete. They're
+// opt in: link this file, along with src/Malloc.cpp, into a program to route
+// its new and delete through the allocator, or preload libmymalloc.so, which
+// includes it.
+//
+// Over-aligned types are served from the smallest size class whose items are
+// all aligned, so they cost no padding, and sized deletes skip most of the
+// lookup a plain free needs, see ArenaStore::freeSized().
+
+/**
+ * Allocates `n` bytes aligned to `alignment`, calling the new handler until it
+ * succeeds or there is no handler. Then the throwing forms throw bad_alloc,
+ * while the nothrow forms return null.
+ */
+template<bool nothrow>
+static void* allocate(size_t n, size_t alignment) {
+    while (true) {
+        void* ptr = alignment <= alignof(std::max_align_t) ? myMalloc(n) : myAlignedAlloc(alignment, n);
+        if (ptr != nullptr) {
+            return ptr;
+        }
+
+        std::new_handler handler = std::get_new_handler();
+        if (handler == nullptr) {
+            if (nothrow) {
+                return nullptr;
+            }
+            throw std::bad_alloc();
+        }
+
+        if (nothrow) {
+            try {
+                handler();
+            } catch (const std::bad_alloc&) {
+                return nullptr;
+            }
+        } else {
+            handler();
+        }
+    }
+}
+
+void* operator new(size_t n) {
+    return allocate<false>(n, alignof(std::max_align_t));
+}
+
+void* operator new[](size_t n) {
+    return allocate<false>(n, alignof(std::max_align_t));
+}
+
+void* operator new(size_t n, const std::nothrow_t&) noexcept {
+    return allocate<true>(n, alignof(std::max_align_t));
+}
+
+void* operator new[](size_t n, const std::nothrow_t&) noexcept {
+    return allocate<true>(n, alignof(std::max_align_t));
+}
+
+void* operator new(size_t n, std::align_val_t alignment) {
+    return allocate<false>(n, static_cast<size_t>(alignment));
+}
+
+void* operator new[](size_t n, std::align_val_t alignment) {
+    return allocate<false>(n, static_cast<size_t>(alignment));
+}
+
+void* operator new(size_t n, std::align_val_t alignment, const std::nothrow_t&) noexcept {
+    return allocate<true>(n, static_cast<size_t>(alignment));
+}
+
+void* operator new[](size_t n, std::align_val_t alignment, const std::nothrow_t&) noexcept {
+    return allocate<true>(n, static_cast<size_t>(alignment));
+}
+
+void operator delete(void* ptr) noexcept {
+    myFree(ptr);
+}
+
+void operator delete[](void* ptr) noexcept {
+    myFree(ptr);
+}
+
+void operator delete(void* ptr, const std::nothrow_t&) noexcept {
+    myFree(ptr);
+}
+
+void operator delete[](void* ptr, const std::nothrow_t&) noexcept {
+    myFree(ptr);
+}
+
+void operator delete(void* ptr, size_t n) noexcept {
+    myFreeSized(ptr, n);
+}
+
+void operator delete[](void* ptr, size_t n) noexcept {
+    myFreeSized(ptr, n);
+}
+
+void operator delete(void* ptr, std::align_val_t) noexcept {
+    myFree(ptr);
+}
+
+void operator delete[](void* ptr, std::align_val_t) noexcept {
+    myFree(ptr);
+}
+
+void operator delete(void* ptr, std::align_val_t, const std::nothrow_t&) noexcept {
+    myFree(ptr);
+}
+
+void operator delete[](void* ptr, std::align_val_t, const std::nothrow_t&) noexcept {
+    myFree(ptr);
+}
+
+void operator delete(void* ptr, size_t n, std::align_val_t alignment) noexcept {
+    myFreeAlignedSized(ptr, static_cast<size_t>(alignment), n);
+}
+
+void operator delete[](void* ptr, size_t n, std::align_val_t alignment) noexcept {
+    myFreeAlignedSized(ptr, static_cast<size_t>(alignment), n);
+}
@@ -0,0 +1,50 @@
+#include <Malloc.hpp>
+#include <malloc.h>
+
+// The libc allocation functions, built into libmymalloc.so so that
+// LD_PRELOAD=./libmymalloc.so puts the allocator under an existing program.
+// The library is built with hidden visibility, so these are all it exports;
+// libc and everything else loaded after it bind to them instead of libc's own.
+// See threadStore() in src/Malloc.cpp for how allocations made while a thread
+// sets itself up are served.
+#define PRELOAD_EXPORT extern "C" __attribute__((visibility("default")))
+
+PRELOAD_EXPORT void* malloc(size_t n) noexcept {
+    return myMalloc(n);
+}
+
+PRELOAD_EXPORT void free(void* ptr) noexcept {
+    myFree(ptr);
+}
+
+PRELOAD_EXPORT void* calloc(size_t count, size_t size) noexcept {
+    return myCalloc(count, size);
+}
+
+PRELOAD_EXPORT void* realloc(void* ptr, size_t n) noexcept {
+    return myRealloc(ptr, n);
+}
+
+PRELOAD_EXPORT int posix_memalign(void** result, size_t alignment, size_t n) noexcept {
+    return myPosixMemalign(result, alignment, n);
+}
+
+PRELOAD_EXPORT void* aligned_alloc(size_t alignment, size_t n) noexcept {
+    return myAlignedAlloc(alignment, n);
+}
+
+PRELOAD_EXPORT void* memalign(size_t alignment, size_t n) noexcept {
+    return myMemalign(alignment, n);
+}
+
+PRELOAD_EXPORT void* valloc(size_t n) noexcept {
+    return myValloc(n);
+}
+
+PRELOAD_EXPORT void* pvalloc(size_t n) noexcept {
+    return myPvalloc(n);
+}
+
+PRELOAD_EXPORT size_t malloc_usable_size(void* ptr) noexcept {
+    return myMallocUsableSize(ptr);
+}
@@ -1,22 +1,314 @@
 #include <Malloc.hpp>
+#include <cerrno>
+#include <new>
+#include <pthread.h>
 #include <sys/mman.h>
 
-thread_local ArenaStore a;
+// This thread's store, made on first use by threadStore(). It lives in plain
+// thread_local storage rather than a thread_local ArenaStore so that reaching
+// it never runs a TLS initialiser or registers a destructor, either of which
+// may allocate and re-enter the allocator when it stands in for malloc().
+__thread ArenaStore* t_store = nullptr;
+static thread_local bool t_makingStore = false;
+alignas(ArenaStore) static thread_local char t_storeMemory[sizeof(ArenaStore)];
+
+// Tears down each thread's store when it exits.
+static pthread_key_t s_storeKey;
+static pthread_once_t s_storeKeyOnce = PTHREAD_ONCE_INIT;
+
+/**
+ * Allocations made while a thread is still making its store, should making it
+ * re-enter the allocator, come from this buffer. They are never given back:
+ * myFree() ignores them, as they aren't in the page map.
+ */
+constexpr size_t bootstrapSize = 64 << 10;
+alignas(pageSize) static char s_bootstrap[bootstrapSize];
+static std::atomic<size_t> s_bootstrapUsed = 0;
+
+// Bootstrap allocations are preceded by a header holding their size.
+constexpr size_t bootstrapHeader = alignof(std::max_align_t);
+
+static void* bootstrapAlloc(size_t n, size_t alignment = bootstrapHeader) {
+    alignment = std::max(alignment, bootstrapHeader);
+    if (n > bootstrapSize || alignment > bootstrapSize) {
+        return nullptr;
+    }
+
+    size_t used = s_bootstrapUsed.load(std::memory_order_relaxed);
+    size_t start;
+    do {
+        start = (used + bootstrapHeader + alignment - 1) & ~(alignment - 1);
+        if (start + n > bootstrapSize) {
+            return nullptr;
+        }
+    } while (!s_bootstrapUsed.compare_exchange_weak(used, start + n, std::memory_order_relaxed));
+
+    char* ptr = s_bootstrap + start;
+    reinterpret_cast<size_t*>(ptr)[-1] = n;
+    return ptr;
+}
+
+static bool isBootstrap(const void* ptr) {
+    return ptr >= s_bootstrap && ptr < s_bootstrap + bootstrapSize;
+}
+
+static size_t bootstrapSizeOf(const void* ptr) {
+    return reinterpret_cast<const size_t*>(ptr)[-1];
+}
+
+static void destroyThreadStore(void* store) {
+    t_store = nullptr;
+    static_cast<ArenaStore*>(store)->~ArenaStore();
+}
+
+/**
+ * Holds every lock across fork(), so the child starts with none held by a
+ * thread it doesn't have. They're taken outermost first: a thread can free
+ * into the global cache, which releases into the heap, which takes slab
+ * storage, but never the other way round.
+ */
+static void lockForFork() {
+    BigAllocCache::lockForFork();
+    SizeClassRegions::lockForFork();
+    ArenaHeap::lockForFork();
+    MetadataSlab<BigAlloc>::lockForFork();
+    MetadataSlab<Arena>::lockForFork();
+}
+
+static void unlockAfterFork() {
+    MetadataSlab<Arena>::unlockAfterFork();
+    MetadataSlab<BigAlloc>::unlockAfterFork();
+    ArenaHeap::unlockAfterFork();
+    SizeClassRegions::unlockAfterFork();
+    BigAllocCache::unlockAfterFork();
+}
+
+/**
+ * Runs once, when the first thread makes its store. No lock is taken before
+ * then, so there's nothing for fork() to get wrong.
+ */
+static void makeStoreKey() {
+    pthread_key_create(&s_storeKey, destroyThreadStore);
+    pthread_atfork(lockForFork, unlockAfterFork, unlockAfterFork);
+}
+
+/**
+ * This thread's store, made on first use, or null if the thread is in the
+ * middle of making it. A thread that allocates again after its store is torn
+ * down at exit gets a fresh one, which the next round of key destructors tears
+ * down.
+ */
+static ArenaStore* threadStore() {
+    ArenaStore* store = t_store;
+    if (store != nullptr || t_makingStore) {
+        return store;
+    }
+
+    t_makingStore = true;
+    pthread_once(&s_storeKeyOnce, makeStoreKey);
+    store = new (t_storeMemory) ArenaStore();
+    pthread_setspecific(s_storeKey, store);
+    t_store = store;
+    t_makingStore = false;
+    return store;
+}
+
+void* myMallocSlow(size_t n) {
+    ArenaStore* store = threadStore();
+    void* ret = store != nullptr ? store->alloc(n) : bootstrapAlloc(n);
+    if (ret == nullptr) {
+        errno = ENOMEM;
+    }
+    return ret;
+}
+
+/**
+ * Threads without a store free as any other thread would, rather than make one
+ * just to free.
+ */
+void myFreeSlow(void* addr) {
+    if (t_store != nullptr) {
+        t_store->free(addr);
+    } else {
+        ArenaStore::freeUnowned(addr);
+    }
+}
+
+void myFreeSizedSlow(void* addr, size_t n) {
+    if (isBootstrap(addr)) {
+        return;
+    }
+    if (t_store != nullptr) {
+        t_store->freeSized(addr, n);
+    } else {
+        ArenaStore::freeUnowned(addr);
+    }
+}
+
+/**
+ * myRealloc(), leaving errno alone.
+ */
+static void* reallocWithoutErrno(void* addr, size_t n) {
+    ArenaStore* store = threadStore();
+    if (store == nullptr) {
+        void* ret = bootstrapAlloc(n);
+        if (ret != nullptr && addr != nullptr) {
+            memcpy(ret, addr, std::min(n, isBootstrap(addr) ? bootstrapSizeOf(addr) : ArenaStore::usableSize(addr)));
+        }
+        return ret;
+    }
+
+    if (isBootstrap(addr)) {
+        // Bootstrap memory can't be resized, so move it out.
+        void* ret = store->alloc(n);
+        if (ret != nullptr) {
+            memcpy(ret, addr, std::min(n, bootstrapSizeOf(addr)));
+        }
+        return ret;
+    }
+    return store->realloc(addr, n);
+}
+
+/**
+ * Your special drop-in replacement for realloc(). Should behave the same way.
+ */
+void* myRealloc(void* addr, size_t n) {
+    void* ret = reallocWithoutErrno(addr, n);
+    if (ret == nullptr && n != 0) {
+        errno = ENOMEM;
+    }
+    return ret;
+}
 
 /**
- * Your special drop-in replacement for malloc(). Should behave the same way.
+ * Your special drop-in replacement for calloc(). Should behave the same way.
  */
-void* myMalloc(size_t n) {
-    auto ret = a.alloc(n);
+void* myCalloc(size_t count, size_t size) {
+    ArenaStore* store = threadStore();
+    void* ret;
+    if (store != nullptr) {
+        ret = store->calloc(count, size);
+    } else {
+        // The bootstrap buffer is zero until handed out, and never reused.
+        size_t bytes;
+        ret = __builtin_mul_overflow(count, size, &bytes) ? nullptr : bootstrapAlloc(bytes);
+    }
+
+    if (ret == nullptr) {
+        errno = ENOMEM;
+    }
     return ret;
 }
 
 /**
- * Your special drop-in replacement for free(). Should behave the same way.
+ * Whether `alignment` is a power of two, as every aligned allocation function
+ * requires.
+ */
+static bool validAlignment(size_t alignment) {
+    return alignment != 0 && (alignment & (alignment - 1)) == 0;
+}
+
+/**
+ * Your special drop-in replacement for aligned_alloc(). Should behave the same
+ * way.
  */
-void myFree(void* addr) {
-    a.free(addr);
+void* myAlignedAlloc(size_t alignment, size_t n) {
+    if (!validAlignment(alignment)) {
+        errno = EINVAL;
+        return nullptr;
+    }
+
+    ArenaStore* store = threadStore();
+    void* ret = store != nullptr ? store->allocAligned(n, alignment) : bootstrapAlloc(n, alignment);
+    if (ret == nullptr) {
+        errno = ENOMEM;
+    }
+    return ret;
 }
 
+/**
+ * Your special drop-in replacement for posix_memalign(). Should behave the same
+ * way.
+ */
+int myPosixMemalign(void** result, size_t alignment, size_t n) {
+    if (!validAlignment(alignment) || alignment % sizeof(void*) != 0) {
+        return EINVAL;
+    }
+
+    ArenaStore* store = threadStore();
+    void* ret = store != nullptr ? store->allocAligned(n, alignment) : bootstrapAlloc(n, alignment);
+    if (ret == nullptr) {
+        return ENOMEM;
+    }
+
+    *result = ret;
+    return 0;
+}
+
+/**
+ * Your special drop-in replacement for memalign(). Should behave the same way.
+ */
+void* myMemalign(size_t alignment, size_t n) {
+    return myAlignedAlloc(alignment, n);
+}
+
+/**
+ * Your special drop-in replacement for valloc(). Should behave the same way.
+ */
+void* myValloc(size_t n) {
+    return myAlignedAlloc(systemPageSize(), n);
+}
+
+/**
+ * Your special drop-in replacement for pvalloc(). Should behave the same way.
+ */
+void* myPvalloc(size_t n) {
+    size_t page = systemPageSize();
+    size_t rounded = (n + page - 1) & ~(page - 1);
+    if (rounded < n) {
+        errno = ENOMEM;
+        return nullptr;
+    }
+    return myAlignedAlloc(page, std::max(rounded, page));
+}
+
+/**
+ * Your special drop-in replacement for malloc_usable_size(). Should behave the
+ * same way.
+ */
+size_t myMallocUsableSize(void* addr) {
+    return isBootstrap(addr) ? bootstrapSizeOf(addr) : ArenaStore::usableSize(addr);
+}
+
+/**
+ * How many bytes myMalloc(n) would really give you, like nallocx().
+ */
+size_t myGoodSize(size_t n) {
+    return ArenaStore::goodSize(n);
+}
+
+/**
+ * Allocates at least `n` bytes and stores how many you really got in `actual`,
+ * if it isn't null, in the spirit of std::allocator::allocate_at_least().
+ */
+void* myMallocAtLeast(size_t n, size_t* actual) {
+    ArenaStore* store = threadStore();
+    size_t size = n;
+    void* ret = store != nullptr ? store->allocAtLeast(n, size) : bootstrapAlloc(n);
+    if (actual != nullptr) {
+        *actual = size;
+    }
+    return ret;
+}
+
+/**
+ * Writes a per size class breakdown of what this thread has asked for versus
+ * what it was given.
+ */
+void myMallocReport(std::ostream& out) {
+    if (ArenaStore* store = threadStore()) {
+        store->report(out);
+    }
+}
 
 std::atomic<size_t> MMapObject::s_outstandingPages = 0;
\ No newline at end of file
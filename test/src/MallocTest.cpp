@@ -1,22 +1,34 @@
 #include <Malloc.hpp>
+#include <ArenaAllocator.hpp>
+#include <ArenaResource.hpp>
 #include <TestSuite.hpp>
 #include <Assert.hpp>
 #include <TestSuite.hpp>
+#include <cerrno>
 #include <cstdlib>
+#include <cstring>
+#include <fstream>
 #include <thread>
+#include <unistd.h>
+#include <sys/mman.h>
 #include <sys/resource.h>
+#include <sys/wait.h>
 #include <iostream>
-
-size_t expectedArenaAllocations(size_t blockSize) {
-    return (pageSize - sizeof(Arena)) / blockSize;
+#include <list>
+#include <map>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+size_t expectedArenaAllocations(size_t blockSize, size_t spanSize = pageSize) {
+    return spanSize / blockSize;
 }
 
 size_t getArenaSize(size_t n) {
-    for (size_t i = 0; i < 8; i++) {
-        size_t arenaSize = 0x8 << i;
-
-        if (n <= arenaSize) {
-            return arenaSize;
+    for (const SizeClass& sizeClass : sizeClasses) {
+        if (n <= sizeClass.size) {
+            return sizeClass.size;
         }
     }
 
@@ -36,31 +48,6 @@ public:
     }
 };
 
-template <typename T> class MyAllocator {
-public:
-    typedef T value_type;
-    MyAllocator() noexcept {} //default ctor not required by C++ Standard Library
-
-    // A converting copy constructor:
-    template<class U> MyAllocator(const MyAllocator<U>&) noexcept {}
-    template<class U> bool operator==(const MyAllocator<U>&) const noexcept
-    {
-        return true;
-    }
-    template<class U> bool operator!=(const MyAllocator<U>&) const noexcept
-    {
-        return false;
-    }
-
-    T* allocate(size_t n, const void* hint = nullptr) {
-        return static_cast<T*>(myMalloc(n * sizeof(T)));
-    }
-
-    void deallocate(T* const ptr, size_t _) const noexcept {
-        myFree(ptr);
-    }
-};
-
 /**
  * For the single and multi-threaded tests, sets the number of iterations
  * of malloc and free.
@@ -110,13 +97,43 @@ void mmapObjectHasCorrectSize() {
 
     ASSERT_TRUE(data != nullptr);
 
-    auto mmapObjectPtr = reinterpret_cast<MMapObject*>(((char*)data - sizeof(BigAlloc)));
+    // The header lives out of line and is found through the page map.
+    auto mmapObjectPtr = MMapObject::find(data);
 
-    ASSERT_EQ(mmapObjectPtr->mmapSize(), 1234 + sizeof(BigAlloc));
+    ASSERT_TRUE(mmapObjectPtr != nullptr);
+    ASSERT_EQ(mmapObjectPtr->mmapSize(), 1234);
     ASSERT_EQ(mmapObjectPtr->arenaSize(), 0);
-    ASSERT_TRUE(data != mmapObjectPtr);
+    ASSERT_EQ(reinterpret_cast<uintptr_t>(data) % pageSize, 0);
+    ASSERT_TRUE(static_cast<void*>(mmapObjectPtr) != data);
+
+    MMapObject::dealloc(data);
+}
+
+void pageMapRejectsForeignPointers() {
+    int local = 0;
+    std::vector<char> heap(64);
+
+    ASSERT_EQ(MMapObject::find(&local), nullptr);
+    ASSERT_EQ(MMapObject::find(heap.data()), nullptr);
+    ASSERT_EQ(MMapObject::find(nullptr), nullptr);
 
-    MMapObject::dealloc(mmapObjectPtr);
+    // Freeing them is a no-op rather than a crash.
+    ArenaStore store;
+    store.free(&local);
+    store.free(heap.data());
+    store.free(nullptr);
+
+    // Once given back, an arena's pages no longer map to anything.
+    Arena* arena = Arena::create(64, 4 * pageSize);
+    char* slots = arena->slots();
+
+    ASSERT_EQ(MMapObject::find(slots + 3 * pageSize), arena);
+    ASSERT_TRUE(arena->retire());
+    Arena::destroy(arena);
+    ASSERT_EQ(MMapObject::find(slots), nullptr);
+    ASSERT_EQ(MMapObject::find(slots + 3 * pageSize), nullptr);
+
+    ASSERT_EQ(MMapObject::outstandingPages(), 0);
 }
 
 void arenaHasCorrectSize() {
@@ -127,15 +144,25 @@ void arenaHasCorrectSize() {
 
     ASSERT_EQ(arena->mmapSize(), pageSize);
     ASSERT_EQ(arena->arenaSize(), 16);
-    ASSERT_EQ(arena->next(), reinterpret_cast<char*>(arena) + sizeof(Arena))
-
-    MMapObject::dealloc(arena);
+    ASSERT_EQ(arena->next(), arena->slots());
+
+    // The arena's metadata lives outside its span, which is page aligned and
+    // found through the page map.
+    ASSERT_EQ(reinterpret_cast<uintptr_t>(arena->slots()) % pageSize, 0);
+    ASSERT_TRUE(reinterpret_cast<char*>(arena) < arena->slots()
+        || reinterpret_cast<char*>(arena) >= arena->slots() + arena->mmapSize());
+    ASSERT_TRUE(ArenaHeap::contains(arena->slots()));
+    ASSERT_TRUE(!ArenaHeap::contains(arena));
+    ASSERT_EQ(ArenaHeap::arenaFor(arena->slots() + pageSize - 1), arena);
+
+    Arena::destroy(arena);
     ASSERT_EQ(MMapObject::outstandingPages(), 0);
 }
 
 void canAllocCorrectNumberOfBlocks() {
-    for (size_t arenaSize = 8; arenaSize <= 1024; arenaSize *= 2) {
-        Arena* arena = Arena::create(arenaSize);
+    for (const SizeClass& sizeClass : sizeClasses) {
+        size_t arenaSize = sizeClass.size;
+        Arena* arena = Arena::create(arenaSize, sizeClass.spanSize);
         size_t numAllocs = 0;
 
         while(!arena->full()) {
@@ -144,18 +171,20 @@ void canAllocCorrectNumberOfBlocks() {
             // ptr should not be null
             ASSERT_TRUE(ptr != nullptr);
 
-            // Assert pointer is 64-bit aligned
+            // Assert pointer is 64-bit aligned, and 16-byte aligned like malloc()
+            // for items big enough to need it.
             ASSERT_EQ(reinterpret_cast<intptr_t>(ptr) % 8, 0);
+            ASSERT_TRUE(arenaSize < 16 || reinterpret_cast<intptr_t>(ptr) % 16 == 0);
 
             numAllocs++;
         }
 
-        MMapObject::dealloc(arena);
+        Arena::destroy(arena);
 
-        size_t expectedAllocations = expectedArenaAllocations(arenaSize);
+        size_t expectedAllocations = expectedArenaAllocations(arenaSize, sizeClass.spanSize);
 
-        // Assert we didn't alloc beyond a page boundary.
-        ASSERT_TRUE(arenaSize * numAllocs + sizeof(Arena) <= pageSize);
+        // Assert we didn't alloc beyond the end of the span.
+        ASSERT_TRUE(arenaSize * numAllocs <= sizeClass.spanSize);
 
         // Assert we got the corrct number of allocations.
         ASSERT_EQ(expectedAllocations, numAllocs);
@@ -165,34 +194,1134 @@ void canAllocCorrectNumberOfBlocks() {
 }
 
 void canFreeCorrectNumberOfBlocks() {
-    for (size_t arenaSize = 8; arenaSize <= 1024; arenaSize *= 2) {
-        Arena* arena = Arena::create(arenaSize);
+    for (const SizeClass& sizeClass : sizeClasses) {
+        size_t arenaSize = sizeClass.size;
+        Arena* arena = Arena::create(arenaSize, sizeClass.spanSize);
         size_t numAllocs = 0;
 
-        size_t expectedAllocations = expectedArenaAllocations(arenaSize);
+        size_t expectedAllocations = expectedArenaAllocations(arenaSize, sizeClass.spanSize);
+
+        std::vector<void*> ptrs;
 
         for (size_t i = 0; i < expectedAllocations; i++) {
-            void* ptr = arena->alloc();
+            ptrs.push_back(arena->alloc());
         }
 
         ASSERT_TRUE(arena->full());
+        ASSERT_TRUE(!arena->retire());
 
         for (size_t i = 0; i < expectedAllocations - 1; i++) {
-            ASSERT_TRUE(!arena->free());
+            ASSERT_TRUE(!arena->free(ptrs[i]));
+        }
+
+        ASSERT_TRUE(arena->free(ptrs.back()));
+
+        Arena::destroy(arena);
+    }
+
+    ASSERT_EQ(MMapObject::outstandingPages(), 0);
+}
+
+void arenaReusesFreedSlots() {
+    Arena* arena = Arena::create(32);
+
+    void* first = arena->alloc();
+    void* second = arena->alloc();
+    char* next = arena->next();
+
+    // Freed slots come back most recently freed first, without touching the
+    // bump pointer.
+    arena->freeLocal(first);
+    arena->freeLocal(second);
+    ASSERT_EQ(arena->alloc(), second);
+    ASSERT_EQ(arena->alloc(), first);
+    ASSERT_EQ(arena->next(), next);
+
+    arena->freeLocal(first);
+    arena->freeLocal(second);
+    ASSERT_TRUE(arena->retire());
+
+    Arena::destroy(arena);
+    ASSERT_EQ(MMapObject::outstandingPages(), 0);
+}
+
+void bitmapArenaFillsPage() {
+    for (const SizeClass& sizeClass : sizeClasses) {
+        size_t arenaSize = sizeClass.size;
+        Arena* arena = Arena::create(arenaSize, sizeClass.spanSize, SlotMode::Bitmap);
+        std::vector<void*> ptrs;
+
+        ASSERT_EQ(arena->freeSlots(), arena->capacity());
+
+        while (!arena->full()) {
+            void* ptr = arena->alloc();
+
+            ASSERT_TRUE(ptr != nullptr);
+            ASSERT_EQ(reinterpret_cast<intptr_t>(ptr) % 8, 0);
+
+            // Slots come out in address order.
+            ASSERT_TRUE(ptrs.empty() || ptr > ptrs.back());
+            ptrs.push_back(ptr);
+        }
+
+        // The bitmap lives with the arena's metadata, so it costs no slots.
+        ASSERT_EQ(ptrs.size(), arena->capacity());
+        ASSERT_EQ(ptrs.size(), expectedArenaAllocations(arenaSize, sizeClass.spanSize));
+        ASSERT_EQ(arena->freeSlots(), 0);
+        ASSERT_TRUE(!arena->retire());
+
+        for (size_t i = 0; i < ptrs.size() - 1; i++) {
+            ASSERT_TRUE(!arena->free(ptrs[i]));
+        }
+
+        ASSERT_TRUE(arena->free(ptrs.back()));
+
+        Arena::destroy(arena);
+    }
+
+    ASSERT_EQ(MMapObject::outstandingPages(), 0);
+}
+
+void wholePageHoldsItems() {
+    // With no header in the page, power of two classes fill it exactly.
+    for (size_t arenaSize = 8; arenaSize <= 1024; arenaSize *= 2) {
+        Arena* arena = Arena::create(arenaSize);
+        std::vector<char*> ptrs;
+
+        while (!arena->full()) {
+            char* ptr = static_cast<char*>(arena->alloc());
+
+            ASSERT_EQ(ArenaHeap::arenaFor(ptr), arena);
+            ptrs.push_back(ptr);
+        }
+
+        ASSERT_EQ(ptrs.size(), pageSize / arenaSize);
+        ASSERT_EQ(ptrs.front(), arena->slots());
+        ASSERT_EQ(ptrs.back() + arenaSize, arena->slots() + pageSize);
+
+        for (auto ptr : ptrs) {
+            arena->free(ptr);
+        }
+
+        Arena::destroy(arena);
+    }
+
+    ASSERT_EQ(MMapObject::outstandingPages(), 0);
+}
+
+void bitmapArenaReusesLowestSlot() {
+    Arena* arena = Arena::create(16, pageSize, SlotMode::Bitmap);
+
+    void* first = arena->alloc();
+    void* second = arena->alloc();
+    void* third = arena->alloc();
+
+    arena->freeLocal(third);
+    arena->freeLocal(first);
+    ASSERT_EQ(arena->freeSlots(), arena->capacity() - 1);
+
+    // The lowest free address wins, regardless of free order.
+    ASSERT_EQ(arena->alloc(), first);
+    ASSERT_EQ(arena->alloc(), third);
+
+    arena->freeLocal(first);
+    arena->freeLocal(second);
+    arena->freeLocal(third);
+    ASSERT_TRUE(arena->retire());
+
+    Arena::destroy(arena);
+    ASSERT_EQ(MMapObject::outstandingPages(), 0);
+}
+
+void arenaCollectsRemoteFrees() {
+    for (SlotMode mode : {SlotMode::FreeList, SlotMode::Bitmap}) {
+        Arena* arena = Arena::create(64, pageSize, mode);
+        std::vector<void*> ptrs;
+
+        for (size_t i = 0; i < arena->capacity() - 1; i++) {
+            ptrs.push_back(arena->alloc());
+        }
+
+        // Items freed from another thread aren't reused until the owner has
+        // run out of slots of its own.
+        size_t emptied = 0;
+        std::thread([&] {
+            for (auto ptr : ptrs) {
+                emptied += arena->free(ptr);
+            }
+        }).join();
+
+        ASSERT_EQ(emptied, 0);
+        ASSERT_EQ(arena->freeSlots(), arena->capacity());
+
+        void* last = arena->alloc();
+        ASSERT_TRUE(last > ptrs.back());
+        ASSERT_TRUE(!arena->full());
+
+        for (auto& ptr : ptrs) {
+            ptr = arena->alloc();
+            ASSERT_TRUE(ptr != nullptr);
+        }
+
+        ASSERT_TRUE(arena->full());
+        ASSERT_EQ(arena->alloc(), nullptr);
+        ASSERT_TRUE(!arena->retire());
+        ASSERT_EQ(arena->owner(), nullptr);
+
+        for (auto ptr : ptrs) {
+            ASSERT_TRUE(!arena->free(ptr));
+        }
+
+        ASSERT_TRUE(arena->free(last));
+
+        Arena::destroy(arena);
+    }
+
+    ASSERT_EQ(MMapObject::outstandingPages(), 0);
+}
+
+size_t countMappings() {
+    std::ifstream maps("/proc/self/maps");
+    std::string line;
+    size_t count = 0;
+
+    while (std::getline(maps, line)) {
+        count++;
+    }
+
+    return count;
+}
+
+void heapCoalescesReleasedSpans() {
+    size_t third = maxSpanPages;
+
+    // A page either side stays allocated, so nothing else merges in.
+    char* guarded = ArenaHeap::allocSpan(3 * third + 2, nullptr);
+    ASSERT_TRUE(guarded != nullptr);
+    ASSERT_TRUE(ArenaHeap::contains(guarded));
+
+    char* span = guarded + pageSize;
+
+    // Released out of order, the three pieces still merge into one run that can
+    // serve the whole span again.
+    ArenaHeap::releaseSpan(span + third * pageSize, third);
+    ArenaHeap::releaseSpan(span, third);
+    ArenaHeap::releaseSpan(span + 2 * third * pageSize, third);
+
+    char* again = ArenaHeap::allocSpan(3 * third, nullptr);
+    ASSERT_TRUE(again == span);
+
+    ArenaHeap::releaseSpan(guarded, 3 * third + 2);
+}
+
+void bigAllocsShareTheHeap() {
+    std::vector<void*> ptrs;
+    size_t mappings = countMappings();
+
+    for (size_t i = 0; i < 4096; i++) {
+        void* ptr = BigAlloc::alloc(40'000 + i);
+
+        ASSERT_TRUE(ArenaHeap::contains(ptr));
+        ASSERT_EQ(MMapObject::find(ptr)->arenaSize(), 0);
+        ptrs.push_back(ptr);
+    }
+
+    // Carving from the heap only changes its protection a chunk at a time.
+    ASSERT_TRUE(countMappings() < mappings + 16);
+
+    for (auto ptr : ptrs) {
+        MMapObject::dealloc(ptr);
+    }
+
+    ASSERT_EQ(MMapObject::outstandingPages(), 0);
+}
+
+void hugePagesAlignBigAllocs() {
+    HugePages::setMode(HugePageMode::Transparent);
+
+    void* small = BigAlloc::alloc(40'000);
+    void* carved = BigAlloc::alloc(3 << 20);
+    void* mapped = BigAlloc::alloc(ArenaHeap::maxSpanSize + 1);
+
+    ASSERT_TRUE(ArenaHeap::contains(carved));
+    ASSERT_TRUE(!ArenaHeap::contains(mapped));
+    ASSERT_EQ(reinterpret_cast<uintptr_t>(carved) % hugePageSize, 0);
+    ASSERT_EQ(reinterpret_cast<uintptr_t>(mapped) % hugePageSize, 0);
+
+    // Touching the memory makes it resident, whatever the kernel backs it with.
+    memset(carved, 1, 3 << 20);
+    HugePages::Coverage coverage = ArenaHeap::coverage();
+    ASSERT_TRUE(coverage.residentBytes >= size_t(3 << 20));
+    ASSERT_TRUE(coverage.hugeBytes <= coverage.residentBytes);
+
+    MMapObject::dealloc(small);
+    MMapObject::dealloc(carved);
+    MMapObject::dealloc(mapped);
+
+    HugePages::setMode(HugePageMode::Off);
+
+    ASSERT_EQ(MMapObject::outstandingPages(), 0);
+}
+
+void releaseGranuleSparesNeighbours() {
+    ASSERT_EQ(systemPageSize(), size_t(sysconf(_SC_PAGESIZE)));
+    ASSERT_TRUE(HugePages::releaseGranule() >= pageSize);
+
+    // A granule bigger than a page, as on hosts with 16 KiB or 64 KiB pages.
+    // Releasing a span must leave its neighbours' data alone.
+    HugePages::setMode(HugePageMode::Transparent);
+
+    std::vector<void*> ptrs;
+    for (size_t i = 0; i < 64; i++) {
+        void* ptr = BigAlloc::alloc(pageSize);
+        memset(ptr, int(i + 1), pageSize);
+        ptrs.push_back(ptr);
+    }
+
+    for (size_t i = 0; i < ptrs.size(); i += 2) {
+        MMapObject::dealloc(ptrs[i]);
+    }
+    for (size_t i = 1; i < ptrs.size(); i += 2) {
+        ASSERT_EQ(static_cast<char*>(ptrs[i])[0], char(i + 1));
+        ASSERT_EQ(static_cast<char*>(ptrs[i])[pageSize - 1], char(i + 1));
+        MMapObject::dealloc(ptrs[i]);
+    }
+
+    HugePages::setMode(HugePageMode::Off);
+
+    ASSERT_EQ(MMapObject::outstandingPages(), 0);
+
+    // Memory madvise() fails to give back isn't reported as zero.
+    char* unmapped = HugePages::map(pageSize);
+    munmap(unmapped, HugePages::mappingSize(pageSize));
+    ASSERT_TRUE(!HugePages::release(unmapped, pageSize, unmapped, unmapped + pageSize));
+}
+
+void bigAllocCacheReusesAllocations() {
+    BigAllocCache global(64 * pageSize, nullptr, true);
+    BigAllocCache cache(16 * pageSize, &global, false);
+
+    // Same page count, so the same allocation comes back.
+    void* ptr = BigAlloc::alloc(8 * pageSize);
+    cache.free(static_cast<BigAlloc*>(MMapObject::find(ptr)), 0);
+    ASSERT_EQ(cache.bytes(), 8 * pageSize);
+    ASSERT_EQ(MMapObject::outstandingPages(), 0);
+
+    ASSERT_EQ(cache.alloc(4 * pageSize, 1), nullptr);
+    ASSERT_EQ(cache.alloc(8 * pageSize - 100, 1), ptr);
+    ASSERT_EQ(MMapObject::find(ptr)->mmapSize(), 8 * pageSize - 100);
+    ASSERT_EQ(cache.hits(), 1);
+    ASSERT_EQ(cache.misses(), 1);
+
+    // Past the capacity, the oldest overflow into the global cache, where the
+    // thread's cache can still find them.
+    void* first = ptr;
+    void* second = BigAlloc::alloc(8 * pageSize);
+    void* third = BigAlloc::alloc(8 * pageSize);
+    cache.free(static_cast<BigAlloc*>(MMapObject::find(first)), 2);
+    cache.free(static_cast<BigAlloc*>(MMapObject::find(second)), 3);
+    cache.free(static_cast<BigAlloc*>(MMapObject::find(third)), 4);
+    ASSERT_EQ(cache.bytes(), 16 * pageSize);
+    ASSERT_EQ(global.bytes(), 8 * pageSize);
+
+    ASSERT_EQ(cache.alloc(8 * pageSize, 5), third);
+    ASSERT_EQ(cache.alloc(8 * pageSize, 5), second);
+    ASSERT_EQ(cache.alloc(8 * pageSize, 5), first);
+    ASSERT_EQ(global.bytes(), 0);
+
+    // Allocations cached for maxAge are evicted, here all the way out.
+    cache.free(static_cast<BigAlloc*>(MMapObject::find(first)), 10);
+    cache.free(static_cast<BigAlloc*>(MMapObject::find(second)), 10 + BigAllocCache::maxAge);
+    ASSERT_EQ(cache.alloc(pageSize, 10 + 2 * BigAllocCache::maxAge), nullptr);
+    ASSERT_EQ(cache.bytes(), 0);
+    ASSERT_EQ(global.alloc(pageSize, 10 + 3 * BigAllocCache::maxAge), nullptr);
+    ASSERT_EQ(global.bytes(), 0);
+
+    // Too big to cache.
+    void* big = BigAlloc::alloc(BigAllocCache::maxCachedSize + 1);
+    cache.free(static_cast<BigAlloc*>(MMapObject::find(big)), 20);
+    ASSERT_EQ(cache.bytes(), 0);
+    ASSERT_EQ(MMapObject::find(big), nullptr);
+
+    MMapObject::dealloc(third);
+    ASSERT_EQ(MMapObject::outstandingPages(), 0);
+}
+
+void storeReallocsInPlace() {
+    {
+        ArenaStore store;
+
+        // An arena item stays put while it fits its slot, and moves with its
+        // contents when it doesn't.
+        char* item = static_cast<char*>(store.realloc(nullptr, 20));
+        size_t slot = MMapObject::find(item)->arenaSize();
+        memset(item, 7, 20);
+        ASSERT_EQ(store.realloc(item, slot), item);
+
+        char* moved = static_cast<char*>(store.realloc(item, 1000));
+        ASSERT_TRUE(moved != item);
+        ASSERT_EQ(moved[0], 7);
+        ASSERT_EQ(moved[19], 7);
+
+        // A big allocation from the heap shrinks in place, and grows into the
+        // pages after it when they're free.
+        char* big = static_cast<char*>(store.realloc(moved, 100'000));
+        ASSERT_EQ(big[19], 7);
+        ASSERT_EQ(store.realloc(big, 50'000), big);
+        ASSERT_EQ(MMapObject::find(big)->mmapSize(), 50'000);
+
+        char* grown = static_cast<char*>(store.realloc(big, 200'000));
+        ASSERT_EQ(grown[0], 7);
+        ASSERT_EQ(MMapObject::find(grown)->mmapSize(), 200'000);
+
+        // One with a mapping of its own is remapped rather than copied.
+        size_t huge = ArenaHeap::maxSpanSize + pageSize;
+        char* mapped = static_cast<char*>(store.alloc(huge));
+        mapped[0] = 1;
+        mapped[huge - 1] = 2;
+
+        char* remapped = static_cast<char*>(store.realloc(mapped, 2 * huge));
+        ASSERT_EQ(remapped[0], 1);
+        ASSERT_EQ(remapped[huge - 1], 2);
+        ASSERT_EQ(MMapObject::find(remapped)->mmapSize(), 2 * huge);
+        ASSERT_TRUE(remapped == mapped || MMapObject::find(mapped) == nullptr);
+
+        ASSERT_EQ(store.realloc(remapped, huge), remapped);
+        ASSERT_EQ(remapped[huge - 1], 2);
+
+        // Sizes that can't be had fail, and leave the allocation as it was.
+        ASSERT_EQ(store.realloc(remapped, SIZE_MAX), nullptr);
+        ASSERT_EQ(store.realloc(grown, SIZE_MAX - pageSize), nullptr);
+        ASSERT_EQ(remapped[huge - 1], 2);
+        ASSERT_EQ(grown[0], 7);
+
+        ASSERT_EQ(store.realloc(remapped, 0), nullptr);
+        ASSERT_EQ(store.realloc(grown, 0), nullptr);
+
+        // Multi-MiB allocations have mappings of their own, so growing one never
+        // copies it, even with the heap taken up right after it.
+        char* buffer = static_cast<char*>(store.alloc(BigAlloc::minMappedSize));
+        ASSERT_TRUE(!ArenaHeap::contains(buffer));
+        void* blocker = store.alloc(BigAlloc::minMappedSize / 2);
+        BigAlloc* obj = static_cast<BigAlloc*>(MMapObject::find(buffer));
+        for (size_t size = 2 * BigAlloc::minMappedSize; size <= (size_t(64) << 20); size *= 2) {
+            buffer[size / 2 - 1] = 3;
+            ASSERT_TRUE(BigAlloc::resize(obj, size));
+            buffer = obj->data();
+            ASSERT_EQ(buffer[size / 2 - 1], 3);
+        }
+        store.free(blocker);
+        store.free(buffer);
+    }
+
+    ASSERT_EQ(MMapObject::outstandingPages(), 0);
+}
+
+/**
+ * The number of pages in the MAP_HUGETLB pool no mapping has taken, from
+ * /proc/meminfo. Mapped pages count as reserved until they're touched.
+ */
+static size_t freeHugeTlbPages() {
+    std::ifstream meminfo("/proc/meminfo");
+    std::string line;
+    size_t free = 0;
+    size_t reserved = 0;
+    while (std::getline(meminfo, line)) {
+        sscanf(line.c_str(), "HugePages_Free: %zu", &free);
+        sscanf(line.c_str(), "HugePages_Rsvd: %zu", &reserved);
+    }
+    return free - reserved;
+}
+
+void explicitHugeMappingsShrink() {
+    // Needs a block backed by the hugetlb pool, which is usually empty.
+    size_t freePages = freeHugeTlbPages();
+    if (freePages < BigAlloc::minMappedSize / hugePageSize) {
+        return;
+    }
+
+    HugePages::setMode(HugePageMode::Explicit);
+
+    {
+        ArenaStore store;
+
+        // Shrinking below a huge page can't unmap part of one, so the block moves
+        // rather than claim a size its mapping doesn't have.
+        char* buffer = static_cast<char*>(store.alloc(BigAlloc::minMappedSize));
+        ASSERT_EQ(freeHugeTlbPages(), freePages - BigAlloc::minMappedSize / hugePageSize);
+        buffer[0] = 4;
+        buffer[hugePageSize / 2] = 5;
+
+        char* shrunk = static_cast<char*>(store.realloc(buffer, hugePageSize / 2 + 1));
+        ASSERT_EQ(shrunk[0], 4);
+        ASSERT_EQ(shrunk[hugePageSize / 2], 5);
+        ASSERT_EQ(freeHugeTlbPages(), freePages);
+        store.free(shrunk);
+
+        // Shrinking by whole huge pages gives them back in place.
+        buffer = static_cast<char*>(store.alloc(BigAlloc::minMappedSize));
+        ASSERT_EQ(store.realloc(buffer, hugePageSize), buffer);
+        ASSERT_EQ(freeHugeTlbPages(), freePages - 1);
+        store.free(buffer);
+        ASSERT_EQ(freeHugeTlbPages(), freePages);
+    }
+
+    HugePages::setMode(HugePageMode::Off);
+
+    ASSERT_EQ(MMapObject::outstandingPages(), 0);
+}
+
+void checkMallocFamily() {
+    for (size_t alignment = 8; alignment <= (size_t(1) << 20); alignment *= 2) {
+        for (size_t size : {1, 100, 5000, 100'000}) {
+            char* ptr = static_cast<char*>(myAlignedAlloc(alignment, size));
+            ASSERT_TRUE(ptr != nullptr);
+            ASSERT_EQ(reinterpret_cast<uintptr_t>(ptr) % alignment, 0);
+            memset(ptr, 1, size);
+            myFree(ptr);
+
+            size_t index = alignment <= pageSize ? alignedSizeClassIndex(size, alignment) : numSizeClasses;
+            ASSERT_TRUE(index == numSizeClasses || sizeClasses[index].size % alignment == 0);
+        }
+    }
+
+    // Small alignments cost no padding.
+    ASSERT_EQ(alignedSizeClassIndex(40, 16), sizeClassIndex(48));
+    ASSERT_EQ(alignedSizeClassIndex(100, 64), sizeClassIndex(128));
+    ASSERT_EQ(alignedSizeClassIndex(100, 2 * maxArenaItemSize), numSizeClasses);
+
+    void* result = nullptr;
+    ASSERT_EQ(myPosixMemalign(&result, 3, 64), EINVAL);
+    ASSERT_EQ(myPosixMemalign(&result, 4, 64), EINVAL);
+    ASSERT_EQ(myPosixMemalign(&result, 256, 64), 0);
+    ASSERT_EQ(reinterpret_cast<uintptr_t>(result) % 256, 0);
+    myFree(result);
+    ASSERT_EQ(myAlignedAlloc(24, 64), nullptr);
+
+    char* page = static_cast<char*>(myValloc(10));
+    ASSERT_EQ(reinterpret_cast<uintptr_t>(page) % systemPageSize(), 0);
+    myFree(page);
+    page = static_cast<char*>(myPvalloc(0));
+    ASSERT_EQ(reinterpret_cast<uintptr_t>(page) % systemPageSize(), 0);
+    memset(page, 1, systemPageSize());
+    myFree(page);
+    page = static_cast<char*>(myMemalign(128, 10));
+    ASSERT_EQ(reinterpret_cast<uintptr_t>(page) % 128, 0);
+    myFree(page);
+
+    // calloc zeroes a recycled slot and rejects overflowing sizes.
+    char* dirty = static_cast<char*>(myMalloc(256));
+    memset(dirty, 0xff, 256);
+    myFree(dirty);
+    char* zeroed = static_cast<char*>(myCalloc(32, 8));
+    for (size_t i = 0; i < 256; i++) {
+        ASSERT_EQ(zeroed[i], 0);
+    }
+    myFree(zeroed);
+    ASSERT_EQ(myCalloc(SIZE_MAX / 2, 4), nullptr);
+}
+
+/**
+ * Runs `check` on a thread of its own, so the thread's store and its arenas are
+ * gone before the tests that count pages, and rethrows what it threw.
+ */
+void runOnOwnThread(void (*check)()) {
+    std::exception_ptr failure;
+    std::thread([&] {
+        try {
+            check();
+        } catch (...) {
+            failure = std::current_exception();
+        }
+    }).join();
+
+    if (failure) {
+        std::rethrow_exception(failure);
+    }
+}
+
+void mallocFamilyAlignsAndZeroes() {
+    runOnOwnThread(checkMallocFamily);
+}
+
+void checkHugeRequestsFail() {
+    for (size_t size : {SIZE_MAX, SIZE_MAX - 100, SIZE_MAX - pageSize, SIZE_MAX / 2 + 1}) {
+        errno = 0;
+        ASSERT_EQ(myMalloc(size), nullptr);
+        ASSERT_EQ(errno, ENOMEM);
+
+        errno = 0;
+        ASSERT_EQ(myCalloc(1, size), nullptr);
+        ASSERT_EQ(errno, ENOMEM);
+
+        errno = 0;
+        ASSERT_EQ(myAlignedAlloc(64, size), nullptr);
+        ASSERT_EQ(errno, ENOMEM);
+
+        // A failed realloc leaves the allocation as it was.
+        for (size_t original : {8, 100'000, 10'000'000}) {
+            char* ptr = static_cast<char*>(myMalloc(original));
+            ptr[original - 1] = 5;
+            errno = 0;
+            ASSERT_EQ(myRealloc(ptr, size), nullptr);
+            ASSERT_EQ(errno, ENOMEM);
+            ASSERT_EQ(ptr[original - 1], 5);
+            myFree(ptr);
+        }
+    }
+}
+
+void hugeRequestsFail() {
+    runOnOwnThread(checkHugeRequestsFail);
+
+    ASSERT_EQ(MMapObject::outstandingPages(), 0);
+}
+
+/**
+ * Forks while other threads allocate and free from every part of the
+ * allocator. The child, which has none of those threads, must still be able to
+ * allocate: it mustn't inherit a lock one of them held.
+ */
+void forkWhileAllocating() {
+    constexpr size_t nThreads = 4;
+    constexpr size_t sizes[] = { 16, 1000, 100'000, 2'000'000, 5'000'000 };
+
+    std::atomic<bool> done = false;
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < nThreads; t++) {
+        threads.emplace_back([&]() {
+            while (!done.load(std::memory_order_relaxed)) {
+                for (size_t size : sizes) {
+                    myFree(myMalloc(size));
+                }
+            }
+        });
+    }
+
+    // Threads still running when an assert fails would terminate the tests, so
+    // the children are checked once they're joined.
+    constexpr size_t nForks = 100;
+    size_t cleanExits = 0;
+    for (size_t i = 0; i < nForks; i++) {
+        pid_t child = fork();
+        if (child == 0) {
+            // A deadlock kills the child rather than hanging the tests.
+            alarm(10);
+            for (size_t size : sizes) {
+                void* ptr = myMalloc(size);
+                if (ptr == nullptr) {
+                    _exit(1);
+                }
+                memset(ptr, 1, size);
+                myFree(ptr);
+            }
+            _exit(0);
+        }
+
+        int status;
+        if (child > 0 && waitpid(child, &status, 0) == child && WIFEXITED(status) && WEXITSTATUS(status) == 0) {
+            cleanExits++;
+        }
+    }
+
+    done = true;
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+
+    ASSERT_EQ(cleanExits, nForks);
+}
+
+void callocOnlyZeroesRecycledMemory() {
+    {
+        ArenaStore store;
+
+        // A huge calloc gets fresh pages and leaves them untouched.
+        size_t huge = size_t(1) << 30;
+        char* buffer = static_cast<char*>(store.calloc(huge, 1));
+        ASSERT_TRUE(buffer != nullptr);
+
+        std::vector<unsigned char> resident(huge / systemPageSize());
+        ASSERT_EQ(mincore(buffer, huge, resident.data()), 0);
+        for (unsigned char page : resident) {
+            ASSERT_EQ(page & 1, 0);
+        }
+        ASSERT_EQ(buffer[huge - 1], 0);
+        store.free(buffer);
+
+        // A recycled slot is zeroed by hand.
+        char* item = static_cast<char*>(store.alloc(64));
+        memset(item, 0xff, 64);
+        store.free(item);
+        char* zeroed = static_cast<char*>(store.calloc(8, 8));
+        ASSERT_EQ(zeroed, item);
+        for (size_t i = 0; i < 64; i++) {
+            ASSERT_EQ(zeroed[i], 0);
+        }
+        store.free(zeroed);
+    }
+
+    // Spans only partly given back, as with huge pages, aren't zero, and say so.
+    HugePages::setMode(HugePageMode::Transparent);
+
+    char* dirty = static_cast<char*>(BigAlloc::alloc(40'000));
+    memset(dirty, 0xff, 40'000);
+    MMapObject::dealloc(dirty);
+
+    bool zeroed;
+    char* reused = static_cast<char*>(BigAlloc::alloc(40'000, pageSize, &zeroed));
+    ASSERT_TRUE(reused != dirty || !zeroed);
+    if (zeroed) {
+        for (size_t i = 0; i < 40'000; i++) {
+            ASSERT_EQ(reused[i], 0);
+        }
+    }
+    MMapObject::dealloc(reused);
+
+    HugePages::setMode(HugePageMode::Off);
+
+    ASSERT_EQ(MMapObject::outstandingPages(), 0);
+}
+
+void freeSizedFindsTheAllocation() {
+    {
+        ArenaStore store;
+        std::vector<std::pair<void*, size_t>> ptrs;
+
+        for (size_t size : {1, 8, 100, 4000, 30'000, 40'000, 5'000'000}) {
+            for (size_t i = 0; i < 100; i++) {
+                ptrs.emplace_back(store.alloc(size), size);
+            }
+        }
+
+        // Small but big allocations, as aligned requests can be.
+        ptrs.emplace_back(store.allocAligned(10, 1 << 16), 10);
+
+        store.setArenaLayout(ArenaLayout::ClassRegions);
+        ptrs.emplace_back(store.alloc(24), 24);
+
+        for (auto [ptr, size] : ptrs) {
+            store.freeSized(ptr, size);
+        }
+        store.freeSized(nullptr, 8);
+    }
+
+    ASSERT_EQ(MMapObject::outstandingPages(), 0);
+}
+
+void usableSizeCoversTheSlack() {
+    {
+        ArenaStore store;
+
+        for (size_t size : {0, 1, 600, 1000, 30'000, 40'000, 5'000'000}) {
+            size_t good = ArenaStore::goodSize(size);
+            ASSERT_TRUE(good >= size);
+            ASSERT_TRUE(good >= 1);
+
+            char* ptr = static_cast<char*>(store.alloc(size));
+            ASSERT_EQ(ArenaStore::usableSize(ptr), good);
+            store.free(ptr);
+
+            // The slack is the caller's to use, and to free by.
+            size_t actual = 0;
+            ptr = static_cast<char*>(store.allocAtLeast(size, actual));
+            ASSERT_EQ(actual, good);
+            memset(ptr, 3, actual);
+            store.freeSized(ptr, actual);
+        }
+
+        ASSERT_EQ(ArenaStore::goodSize(600), 640);
+        size_t wholePages = (40'000 + pageSize - 1) / pageSize * pageSize;
+        ASSERT_EQ(ArenaStore::goodSize(40'000), wholePages);
+        ASSERT_EQ(ArenaStore::usableSize(nullptr), 0);
+
+        // realloc keeps what was written to the slack.
+        char* ptr = static_cast<char*>(store.alloc(40'000));
+        ptr[wholePages - 1] = 9;
+        ptr = static_cast<char*>(store.realloc(ptr, 10'000'000));
+        ASSERT_EQ(ptr[wholePages - 1], 9);
+        store.free(ptr);
+    }
+
+    ASSERT_EQ(MMapObject::outstandingPages(), 0);
+}
+
+void checkArenaResource() {
+    std::pmr::memory_resource* resource = arenaResource();
+    ArenaResource other;
+    ASSERT_TRUE(resource->is_equal(other));
+    ASSERT_TRUE(!resource->is_equal(*std::pmr::new_delete_resource()));
+
+    {
+        std::pmr::vector<int> values(resource);
+        for (int i = 0; i < 10'000; i++) {
+            values.push_back(i);
+        }
+        ASSERT_TRUE(myMallocUsableSize(values.data()) >= values.capacity() * sizeof(int));
+
+        // The strings get the map's resource too.
+        std::pmr::unordered_map<int, std::pmr::string> names(resource);
+        for (int i = 0; i < 1'000; i++) {
+            names.emplace(i, std::string(100, 'a' + i % 26));
+        }
+        ASSERT_TRUE(myMallocUsableSize(names.at(7).data()) > 100);
+        ASSERT_EQ(names.at(27)[99], 'b');
+    }
+
+    for (size_t alignment : {size_t(1), size_t(8), size_t(16), size_t(64), size_t(4096), size_t(8192), pageSize}) {
+        for (size_t size : {1, 100, 3'000, 100'000}) {
+            void* ptr = resource->allocate(size, alignment);
+            ASSERT_EQ(reinterpret_cast<uintptr_t>(ptr) % alignment, 0);
+            ASSERT_TRUE(myMallocUsableSize(ptr) >= size);
+            resource->deallocate(ptr, size, alignment);
+        }
+    }
+}
+
+void arenaResourceBacksPmrContainers() {
+    runOnOwnThread(checkArenaResource);
+
+    ASSERT_EQ(MMapObject::outstandingPages(), 0);
+}
+
+/**
+ * A type aligned beyond what myMalloc() guarantees.
+ */
+struct alignas(64) CacheLine {
+    char bytes[64];
+};
+
+void checkArenaAllocator() {
+    using Traits = std::allocator_traits<ArenaAllocator<int>>;
+    static_assert(Traits::is_always_equal::value);
+    static_assert(Traits::propagate_on_container_move_assignment::value);
+    static_assert(std::is_same_v<Traits::rebind_alloc<char>, ArenaAllocator<char>>);
+    static_assert(std::is_empty_v<ArenaAllocator<int>>);
+    ASSERT_TRUE(ArenaAllocator<int>() == ArenaAllocator<char>());
+
+    {
+        std::list<int, ArenaAllocator<int>> evens;
+        std::list<int, ArenaAllocator<int>> odds;
+        for (int i = 0; i < 1'000; i++) {
+            (i % 2 == 0 ? evens : odds).push_back(i);
         }
+        evens.splice(evens.end(), odds);
+        ASSERT_EQ(evens.size(), 1'000);
+        ASSERT_EQ(evens.back(), 999);
 
-        ASSERT_TRUE(arena->free());
+        std::map<int, CacheLine, std::less<int>, ArenaAllocator<std::pair<const int, CacheLine>>> lines;
+        for (int i = 0; i < 1'000; i++) {
+            lines[i].bytes[0] = char(i);
+        }
+        for (auto& line : lines) {
+            ASSERT_EQ(reinterpret_cast<uintptr_t>(&line.second) % alignof(CacheLine), 0);
+        }
+
+        std::vector<int, ArenaAllocator<int>> values(10'000, 7);
+        std::vector<int, ArenaAllocator<int>> empty;
+        values.swap(empty);
+        ASSERT_EQ(empty.size(), 10'000);
+        ASSERT_TRUE(myMallocUsableSize(empty.data()) >= 10'000 * sizeof(int));
+    }
 
-        MMapObject::dealloc(arena);
+    // The slack of the size class comes with the allocation.
+    ArenaAllocator<char> chars;
+    ArenaAllocation<char*> allocation = chars.allocate_at_least(600);
+    ASSERT_EQ(allocation.count, 640);
+    memset(allocation.ptr, 1, allocation.count);
+    chars.deallocate(allocation.ptr, allocation.count);
+
+    ArenaAllocator<CacheLine> cacheLines;
+    ArenaAllocation<CacheLine*> lines = cacheLines.allocate_at_least(3);
+    ASSERT_EQ(reinterpret_cast<uintptr_t>(lines.ptr) % alignof(CacheLine), 0);
+    ASSERT_TRUE(lines.count >= 3);
+    cacheLines.deallocate(lines.ptr, lines.count);
+
+    bool threw = false;
+    try {
+        cacheLines.allocate(cacheLines.max_size() + 1);
+    } catch (const std::bad_array_new_length&) {
+        threw = true;
     }
+    ASSERT_TRUE(threw);
+}
+
+void arenaAllocatorServesContainers() {
+    runOnOwnThread(checkArenaAllocator);
 
     ASSERT_EQ(MMapObject::outstandingPages(), 0);
 }
 
+void sizeClassTableIsConsistent() {
+    for (size_t i = 0; i < numSizeClasses; i++) {
+        const SizeClass& sizeClass = sizeClasses[i];
+
+        ASSERT_EQ(sizeClass.size % 8, 0);
+        ASSERT_EQ(sizeClass.spanSize % pageSize, 0);
+        ASSERT_TRUE(sizeClass.spanSize <= maxSpanPages * pageSize);
+        ASSERT_EQ(sizeClass.slots, expectedArenaAllocations(sizeClass.size, sizeClass.spanSize));
+
+        // Spans are sized so the slots leave little of them unused.
+        ASSERT_TRUE((sizeClass.spanSize - sizeClass.slots * sizeClass.size) * maxSpanWaste <= sizeClass.spanSize);
+        ASSERT_TRUE(i == 0 || sizeClasses[i - 1].size < sizeClass.size);
+    }
+}
+
+void sizeClassIndexRoundsUp() {
+    for (size_t n = 0; n <= maxArenaItemSize; n++) {
+        size_t index = sizeClassIndex(n);
+
+        ASSERT_TRUE(index < numSizeClasses);
+
+        // The class fits the request, and the next smaller one doesn't.
+        ASSERT_TRUE(sizeClasses[index].size >= n);
+        ASSERT_TRUE(index == 0 || sizeClasses[index - 1].size < n);
+        ASSERT_EQ(sizeClasses[index].size, getArenaSize(n == 0 ? 1 : n));
+    }
+}
+
+void multiPageArenasFreeFromEveryPage() {
+    ArenaStore store;
+    std::vector<void*> ptrs;
+
+    // Several spans' worth of the largest class, so some items start pages past
+    // the first page of their arena.
+    for (size_t i = 0; i < 4 * sizeClasses[numSizeClasses - 1].slots; i++) {
+        void* ptr = store.alloc(maxArenaItemSize);
+
+        ASSERT_TRUE(ptr != nullptr);
+        ASSERT_EQ(ArenaHeap::arenaFor(ptr)->arenaSize(), maxArenaItemSize);
+        memset(ptr, 0xDE, maxArenaItemSize);
+        ptrs.push_back(ptr);
+    }
+
+    for (auto ptr : ptrs) {
+        store.free(ptr);
+    }
+
+    // The arena being allocated from stays, plus the empty cache.
+    ASSERT_TRUE(MMapObject::outstandingPages() <= 1 + maxEmptyArenas);
+}
+
+void storeReusesPartialArenas() {
+    {
+        ArenaStore store;
+        size_t slots = sizeClasses[sizeClassIndex(64)].slots;
+        std::vector<void*> ptrs;
+
+        for (size_t i = 0; i < 3 * slots; i++) {
+            ptrs.push_back(store.alloc(64));
+        }
+
+        size_t pages = MMapObject::outstandingPages();
+
+        // Punch holes in the first two arenas, which are full by now.
+        for (size_t i = 0; i < 2 * slots; i += 2) {
+            store.free(ptrs[i]);
+            ptrs[i] = nullptr;
+        }
+
+        // The holes get filled before any new arena is opened.
+        for (size_t i = 0; i < slots; i++) {
+            ptrs.push_back(store.alloc(64));
+        }
+        ASSERT_EQ(MMapObject::outstandingPages(), pages);
+
+        for (auto ptr : ptrs) {
+            if (ptr != nullptr) {
+                store.free(ptr);
+            }
+        }
+
+        // Arenas that emptied out are cached or given back.
+        ASSERT_TRUE(MMapObject::outstandingPages() <= 1 + maxEmptyArenas);
+    }
+
+    ASSERT_EQ(MMapObject::outstandingPages(), 0);
+}
+
+void storeReusesArenasFreedRemotely() {
+    {
+        ArenaStore store;
+        size_t slots = sizeClasses[sizeClassIndex(64)].slots;
+        std::vector<void*> ptrs;
+
+        for (size_t i = 0; i < 2 * slots; i++) {
+            ptrs.push_back(store.alloc(64));
+        }
+
+        size_t pages = MMapObject::outstandingPages();
+
+        // Another thread empties the first arena, which was parked as full.
+        std::thread([&] {
+            ArenaStore other;
+            for (size_t i = 0; i < slots; i++) {
+                other.free(ptrs[i]);
+            }
+        }).join();
+
+        for (size_t i = 0; i < slots; i++) {
+            ptrs[i] = store.alloc(64);
+        }
+        ASSERT_EQ(MMapObject::outstandingPages(), pages);
+
+        for (auto ptr : ptrs) {
+            store.free(ptr);
+        }
+    }
+
+    ASSERT_EQ(MMapObject::outstandingPages(), 0);
+}
+
+void arenaPolicyPicksNextArena() {
+    for (ArenaPolicy policy : {ArenaPolicy::MostFull, ArenaPolicy::LowestAddress, ArenaPolicy::Newest}) {
+        ArenaStore store;
+        store.setArenaPolicy(policy);
+
+        size_t slots = sizeClasses[sizeClassIndex(64)].slots;
+        std::vector<void*> ptrs;
+
+        for (size_t i = 0; i < 3 * slots; i++) {
+            ptrs.push_back(store.alloc(64));
+        }
+
+        Arena* arenas[3];
+        for (size_t i = 0; i < 3; i++) {
+            arenas[i] = ArenaHeap::arenaFor(ptrs[i * slots]);
+        }
+
+        // Leave the arenas, oldest first, with 2, 1 and 3 free slots.
+        size_t holes[3] = { 2, 1, 3 };
+        for (size_t i = 0; i < 3; i++) {
+            for (size_t j = 0; j < holes[i]; j++) {
+                store.free(ptrs[i * slots + j]);
+                ptrs[i * slots + j] = nullptr;
+            }
+        }
+
+        Arena* expected = arenas[1];
+        if (policy == ArenaPolicy::Newest) {
+            expected = arenas[2];
+        } else if (policy == ArenaPolicy::LowestAddress) {
+            expected = *std::min_element(arenas, arenas + 3, [](Arena* a, Arena* b) {
+                return a->slots() < b->slots();
+            });
+        }
+
+        void* ptr = store.alloc(64);
+        ASSERT_EQ(ArenaHeap::arenaFor(ptr), expected);
+        ASSERT_EQ(store.arenaStats().arenasCreated, 3);
+
+        store.free(ptr);
+        for (auto ptr : ptrs) {
+            if (ptr != nullptr) {
+                store.free(ptr);
+            }
+        }
+
+        // Two of the three emptied out while another was being allocated from.
+        ASSERT_EQ(store.arenaStats().arenasReleased, 2 - maxEmptyArenas);
+    }
+
+    ASSERT_EQ(MMapObject::outstandingPages(), 0);
+}
+
+void classRegionsFindArenasByAddress() {
+    std::vector<void*> ptrs;
+
+    {
+        ArenaStore store;
+        store.setArenaLayout(ArenaLayout::ClassRegions);
+
+        for (size_t index = 0; index < numSizeClasses; index++) {
+            const SizeClass& sizeClass = sizeClasses[index];
+
+            // Enough for a few spans, so span numbers past zero are exercised.
+            for (size_t i = 0; i < 3 * sizeClass.slots; i++) {
+                char* ptr = static_cast<char*>(store.alloc(sizeClass.size));
+                Arena* arena = SizeClassRegions::arenaFor(ptr);
+
+                ASSERT_TRUE(SizeClassRegions::contains(ptr));
+                ASSERT_EQ(SizeClassRegions::sizeClassOf(ptr), index);
+                ASSERT_EQ(MMapObject::find(ptr), arena);
+                ASSERT_EQ(arena->arenaSize(), sizeClass.size);
+                ASSERT_TRUE(ptr >= arena->slots() && ptr < arena->slots() + sizeClass.spanSize);
+                ptrs.push_back(ptr);
+            }
+        }
+
+        for (auto ptr : ptrs) {
+            store.free(ptr);
+        }
+    }
+
+    // Released spans no longer resolve to an arena.
+    ASSERT_EQ(MMapObject::find(ptrs.front()), nullptr);
+    ASSERT_EQ(MMapObject::outstandingPages(), 0);
+}
+
+void reportsRequestedAndReservedBytes() {
+    ArenaStore store;
+    std::stringstream report;
+
+    store.free(store.alloc(33));
+    store.free(store.alloc(40));
+    store.free(store.alloc(513));
+
+    store.report(report);
+
+#ifdef MALLOC_STATS
+    // 33 and 40 bytes both land in the 48-byte class; 513 lands in 640.
+    std::string line;
+    bool sawFortyEight = false;
+    bool sawSixForty = false;
+
+    while (std::getline(report, line)) {
+        if (line.rfind("48\t", 0) == 0) {
+            ASSERT_EQ(line.substr(0, line.rfind('\t')), "48\t2\t73\t96");
+            sawFortyEight = true;
+        }
+        if (line.rfind("640\t", 0) == 0) {
+            ASSERT_EQ(line.substr(0, line.rfind('\t')), "640\t1\t513\t640");
+            sawSixForty = true;
+        }
+    }
+
+    ASSERT_TRUE(sawFortyEight);
+    ASSERT_TRUE(sawSixForty);
+#else
+    // Without the counts there are no rows.
+    std::string line;
+    while (std::getline(report, line)) {
+        ASSERT_TRUE(line.rfind("48\t", 0) != 0);
+    }
+#endif
+}
+
+void churnDoesNotGrowPageCount() {
+    ArenaStore store;
+
+    for (size_t i = 0; i < numIterations; i++) {
+        size_t size = sizeClasses[i % numSizeClasses].size;
+        void* ptrs[4];
+
+        for (auto& ptr : ptrs) {
+            ptr = store.alloc(size);
+        }
+
+        for (auto ptr : ptrs) {
+            store.free(ptr);
+        }
+
+        // One arena per size class being allocated from, plus the empty cache.
+        ASSERT_TRUE(MMapObject::outstandingPages() <= numSizeClasses * (1 + maxEmptyArenas));
+    }
+}
+
 void canMallocAndFreeABunchOfStuff() {
     // Scope the vectors so they'll destruct and clear their underlying data.
     {
-        std::vector<volatile char*, MyAllocator<volatile char*>> addresses;
+        std::vector<volatile char*, ArenaAllocator<volatile char*>> addresses;
         addresses.reserve(numIterations);
 
         // The above vectors should have 2 pages.
@@ -216,15 +1345,16 @@ void canMallocAndFreeABunchOfStuff() {
         }
     }
 
-    // Number of outstanding pages should be less than 8 (no more than one per arena)
-    ASSERT_TRUE(MMapObject::outstandingPages() <= 8);
+    // Number of outstanding pages should be no more than one per size class,
+    // plus the empty arenas each class caches
+    ASSERT_TRUE(MMapObject::outstandingPages() <= numSizeClasses * (1 + maxEmptyArenas));
 }
 
 void canMallocAndFreeABunchOfStuffThreaded() {
     // Scope the vectors so they'll destruct and clear their underlying data.
     // This ensures our page counts are accurate at the end of the test.
     {
-        std::vector<volatile char*, MyAllocator<volatile char*>> addresses;
+        std::vector<volatile char*, ArenaAllocator<volatile char*>> addresses;
         addresses.reserve(numIterations);
 
         for (size_t i = 0; i < numIterations; i++) {
@@ -284,8 +1414,9 @@ void canMallocAndFreeABunchOfStuffThreaded() {
         while (doneThreads.load() < nThreads) { }
     }
 
-    // Number of outstanding pages should be less than 8 (no more than one per arena)
-    ASSERT_TRUE(MMapObject::outstandingPages() <= 8);
+    // Number of outstanding pages should be no more than one per size class,
+    // plus the empty arenas each class caches
+    ASSERT_TRUE(MMapObject::outstandingPages() <= numSizeClasses * (1 + maxEmptyArenas));
 }
 
 int runMallocTests() {
@@ -293,9 +1424,39 @@ int runMallocTests() {
 
     TEST(suite, canAllocateBigObject);
     TEST(suite, mmapObjectHasCorrectSize);
+    TEST(suite, pageMapRejectsForeignPointers);
     TEST(suite, arenaHasCorrectSize);
     TEST(suite, canAllocCorrectNumberOfBlocks);
     TEST(suite, canFreeCorrectNumberOfBlocks);
+    TEST(suite, arenaReusesFreedSlots);
+    TEST(suite, bitmapArenaFillsPage);
+    TEST(suite, wholePageHoldsItems);
+    TEST(suite, bitmapArenaReusesLowestSlot);
+    TEST(suite, arenaCollectsRemoteFrees);
+    TEST(suite, heapCoalescesReleasedSpans);
+    TEST(suite, bigAllocsShareTheHeap);
+    TEST(suite, sizeClassTableIsConsistent);
+    TEST(suite, sizeClassIndexRoundsUp);
+    TEST(suite, multiPageArenasFreeFromEveryPage);
+    TEST(suite, storeReusesPartialArenas);
+    TEST(suite, storeReusesArenasFreedRemotely);
+    TEST(suite, arenaPolicyPicksNextArena);
+    TEST(suite, classRegionsFindArenasByAddress);
+    TEST(suite, hugePagesAlignBigAllocs);
+    TEST(suite, releaseGranuleSparesNeighbours);
+    TEST(suite, bigAllocCacheReusesAllocations);
+    TEST(suite, storeReallocsInPlace);
+    TEST(suite, explicitHugeMappingsShrink);
+    TEST(suite, mallocFamilyAlignsAndZeroes);
+    TEST(suite, hugeRequestsFail);
+    TEST(suite, forkWhileAllocating);
+    TEST(suite, callocOnlyZeroesRecycledMemory);
+    TEST(suite, freeSizedFindsTheAllocation);
+    TEST(suite, usableSizeCoversTheSlack);
+    TEST(suite, arenaResourceBacksPmrContainers);
+    TEST(suite, arenaAllocatorServesContainers);
+    TEST(suite, reportsRequestedAndReservedBytes);
+    TEST(suite, churnDoesNotGrowPageCount);
     TEST(suite, canMallocAndFreeABunchOfStuff);
     TEST(suite, canMallocAndFreeABunchOfStuffThreaded);
 